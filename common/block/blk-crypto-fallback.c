@@ -36,6 +36,11 @@ module_param(num_prealloc_fallback_crypt_ctxs, uint, 0);
 MODULE_PARM_DESC(num_prealloc_crypt_fallback_ctxs,
 		 "Number of preallocated bio fallback crypto contexts for blk-crypto to use during crypto API fallback");
 
+static unsigned int crypt_chunk_size = 65536;
+module_param(crypt_chunk_size, uint, 0644);
+MODULE_PARM_DESC(crypt_chunk_size,
+		 "Size in bytes above which the en/decryption of a bio is split across CPUs (0 disables splitting)");
+
 struct bio_fallback_crypt_ctx {
 	struct bio_crypt_ctx crypt_ctx;
 	/*
@@ -57,6 +62,30 @@ struct bio_fallback_crypt_ctx {
 	};
 };
 
+/*
+ * Large bios are en/decrypted in chunks processed in parallel on several CPUs.
+ * The submitter runs the first chunk itself and waits for the rest.
+ */
+struct blk_crypto_fallback_batch {
+	atomic_t pending;
+	blk_status_t status;
+	struct completion done;
+};
+
+struct blk_crypto_fallback_chunk {
+	struct work_struct work;
+	struct blk_crypto_fallback_batch *batch;
+	struct blk_ksm_keyslot *slot;
+	struct bio *bio;
+	/* part of bio to process, starts and ends at segment boundaries */
+	struct bvec_iter iter;
+	/* bounce pages receiving the ciphertext, NULL to decrypt in place */
+	struct bio_vec *dst_bvecs;
+	u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	unsigned int data_unit_size;
+	bool encrypt;
+};
+
 static struct kmem_cache *bio_fallback_crypt_ctx_cache;
 static mempool_t *bio_fallback_crypt_ctx_pool;
 
@@ -79,6 +108,7 @@ static struct blk_crypto_keyslot {
 
 static struct blk_keyslot_manager blk_crypto_ksm;
 static struct workqueue_struct *blk_crypto_wq;
+static struct workqueue_struct *blk_crypto_chunk_wq;
 static mempool_t *blk_crypto_bounce_page_pool;
 
 /*
@@ -251,6 +281,159 @@ static void blk_crypto_dun_to_iv(const u64 dun[BLK_CRYPTO_DUN_ARRAY_SIZE],
 		iv->dun[i] = cpu_to_le64(dun[i]);
 }
 
+/*
+ * En/decrypt one chunk of a bio, one data unit at a time, using the keyslot's
+ * tfm. The tfm may be shared by concurrent chunks since each one uses its own
+ * skcipher_request.
+ */
+static blk_status_t
+blk_crypto_fallback_crypt_chunk(struct blk_crypto_fallback_chunk *chunk)
+{
+	const unsigned int data_unit_size = chunk->data_unit_size;
+	struct skcipher_request *ciph_req = NULL;
+	DECLARE_CRYPTO_WAIT(wait);
+	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
+	struct scatterlist src, dst;
+	union blk_crypto_iv iv;
+	struct bio_vec bv;
+	struct bvec_iter iter;
+	unsigned int i, seg = 0;
+	blk_status_t blk_st = BLK_STS_OK;
+	int err;
+
+	if (!blk_crypto_alloc_cipher_req(chunk->slot, &ciph_req, &wait))
+		return BLK_STS_RESOURCE;
+
+	memcpy(curr_dun, chunk->dun, sizeof(curr_dun));
+	sg_init_table(&src, 1);
+	sg_init_table(&dst, 1);
+
+	skcipher_request_set_crypt(ciph_req, &src, &dst, data_unit_size,
+				   iv.bytes);
+
+	/* Process each segment in the chunk */
+	__bio_for_each_segment(bv, chunk->bio, iter, chunk->iter) {
+		struct page *dst_page = chunk->dst_bvecs ?
+			chunk->dst_bvecs[seg++].bv_page : bv.bv_page;
+
+		sg_set_page(&src, bv.bv_page, data_unit_size, bv.bv_offset);
+		sg_set_page(&dst, dst_page, data_unit_size, bv.bv_offset);
+
+		/* Process each data unit in the segment */
+		for (i = 0; i < bv.bv_len; i += data_unit_size) {
+			blk_crypto_dun_to_iv(curr_dun, &iv);
+			if (chunk->encrypt)
+				err = crypto_skcipher_encrypt(ciph_req);
+			else
+				err = crypto_skcipher_decrypt(ciph_req);
+			if (crypto_wait_req(err, &wait)) {
+				blk_st = BLK_STS_IOERR;
+				goto out;
+			}
+			bio_crypt_dun_increment(curr_dun, 1);
+			src.offset += data_unit_size;
+			dst.offset += data_unit_size;
+		}
+	}
+
+out:
+	skcipher_request_free(ciph_req);
+	return blk_st;
+}
+
+static void blk_crypto_fallback_chunk_done(struct blk_crypto_fallback_chunk *chunk,
+					   blk_status_t blk_st)
+{
+	struct blk_crypto_fallback_batch *batch = chunk->batch;
+
+	if (blk_st)
+		WRITE_ONCE(batch->status, blk_st);
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+static void blk_crypto_fallback_chunk_work(struct work_struct *work)
+{
+	struct blk_crypto_fallback_chunk *chunk =
+		container_of(work, struct blk_crypto_fallback_chunk, work);
+
+	blk_crypto_fallback_chunk_done(chunk,
+				       blk_crypto_fallback_crypt_chunk(chunk));
+}
+
+/*
+ * En/decrypt the range of a bio described by @whole. Ranges larger than
+ * crypt_chunk_size are cut at segment boundaries into up to one chunk per
+ * online CPU; the chunks are queued on the per-CPU chunk workqueue, except the
+ * first one, which is processed by the caller. Must be called from a context
+ * that may sleep.
+ */
+static blk_status_t blk_crypto_fallback_crypt(struct blk_crypto_fallback_chunk *whole)
+{
+	const unsigned int size = whole->iter.bi_size;
+	unsigned int chunk_size = READ_ONCE(crypt_chunk_size);
+	unsigned int nr_chunks, per_chunk, done = 0, seg = 0, n = 0;
+	struct blk_crypto_fallback_chunk *chunks, *chunk;
+	struct blk_crypto_fallback_batch batch;
+	struct bvec_iter iter = whole->iter;
+	unsigned int i;
+	int cpu;
+
+	if (!chunk_size || size <= chunk_size || num_online_cpus() < 2)
+		return blk_crypto_fallback_crypt_chunk(whole);
+
+	nr_chunks = min(DIV_ROUND_UP(size, chunk_size), num_online_cpus());
+	per_chunk = DIV_ROUND_UP(size, nr_chunks);
+
+	chunks = kmalloc_array(nr_chunks, sizeof(*chunks),
+			       GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!chunks)
+		return blk_crypto_fallback_crypt_chunk(whole);
+
+	while (iter.bi_size) {
+		chunk = &chunks[n++];
+		*chunk = *whole;
+		chunk->batch = &batch;
+		chunk->iter = iter;
+		chunk->iter.bi_size = 0;
+		if (whole->dst_bvecs)
+			chunk->dst_bvecs = &whole->dst_bvecs[seg];
+		bio_crypt_dun_increment(chunk->dun,
+					done / whole->data_unit_size);
+
+		/* The last chunk takes whatever is left */
+		while (iter.bi_size &&
+		       (chunk->iter.bi_size < per_chunk || n == nr_chunks)) {
+			struct bio_vec bv = bio_iter_iovec(whole->bio, iter);
+
+			chunk->iter.bi_size += bv.bv_len;
+			bio_advance_iter(whole->bio, &iter, bv.bv_len);
+			seg++;
+		}
+		done += chunk->iter.bi_size;
+	}
+
+	atomic_set(&batch.pending, n);
+	batch.status = BLK_STS_OK;
+	init_completion(&batch.done);
+
+	cpu = raw_smp_processor_id();
+	for (i = 1; i < n; i++) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		INIT_WORK(&chunks[i].work, blk_crypto_fallback_chunk_work);
+		queue_work_on(cpu, blk_crypto_chunk_wq, &chunks[i].work);
+	}
+
+	blk_crypto_fallback_chunk_done(&chunks[0],
+				       blk_crypto_fallback_crypt_chunk(&chunks[0]));
+	wait_for_completion(&batch.done);
+
+	kfree(chunks);
+	return batch.status;
+}
+
 /*
  * The crypto API fallback's encryption routine.
  * Allocate a bounce bio for encryption, encrypt the input bio using crypto API,
@@ -263,13 +446,8 @@ static bool blk_crypto_fallback_encrypt_bio(struct bio **bio_ptr)
 	struct bio *src_bio, *enc_bio;
 	struct bio_crypt_ctx *bc;
 	struct blk_ksm_keyslot *slot;
-	int data_unit_size;
-	struct skcipher_request *ciph_req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
-	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
-	struct scatterlist src, dst;
-	union blk_crypto_iv iv;
-	unsigned int i, j;
+	struct blk_crypto_fallback_chunk whole;
+	unsigned int i;
 	bool ret = false;
 	blk_status_t blk_st;
 
@@ -279,7 +457,6 @@ static bool blk_crypto_fallback_encrypt_bio(struct bio **bio_ptr)
 
 	src_bio = *bio_ptr;
 	bc = src_bio->bi_crypt_context;
-	data_unit_size = bc->bc_key->crypto_cfg.data_unit_size;
 
 	/* Allocate bounce bio for encryption */
 	enc_bio = blk_crypto_clone_bio(src_bio);
@@ -298,51 +475,31 @@ static bool blk_crypto_fallback_encrypt_bio(struct bio **bio_ptr)
 		goto out_put_enc_bio;
 	}
 
-	/* and then allocate an skcipher_request for it */
-	if (!blk_crypto_alloc_cipher_req(slot, &ciph_req, &wait)) {
-		src_bio->bi_status = BLK_STS_RESOURCE;
-		goto out_release_keyslot;
-	}
-
-	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
-	sg_init_table(&src, 1);
-	sg_init_table(&dst, 1);
-
-	skcipher_request_set_crypt(ciph_req, &src, &dst, data_unit_size,
-				   iv.bytes);
-
-	/* Encrypt each page in the bounce bio */
+	/* Replace each page in the bounce bio with a bounce page */
 	for (i = 0; i < enc_bio->bi_vcnt; i++) {
-		struct bio_vec *enc_bvec = &enc_bio->bi_io_vec[i];
-		struct page *plaintext_page = enc_bvec->bv_page;
 		struct page *ciphertext_page =
 			mempool_alloc(blk_crypto_bounce_page_pool, GFP_NOIO);
 
-		enc_bvec->bv_page = ciphertext_page;
-
 		if (!ciphertext_page) {
 			src_bio->bi_status = BLK_STS_RESOURCE;
 			goto out_free_bounce_pages;
 		}
+		enc_bio->bi_io_vec[i].bv_page = ciphertext_page;
+	}
 
-		sg_set_page(&src, plaintext_page, data_unit_size,
-			    enc_bvec->bv_offset);
-		sg_set_page(&dst, ciphertext_page, data_unit_size,
-			    enc_bvec->bv_offset);
+	/* Encrypt the plaintext of src_bio into the bounce pages */
+	whole.slot = slot;
+	whole.bio = src_bio;
+	whole.iter = src_bio->bi_iter;
+	whole.dst_bvecs = enc_bio->bi_io_vec;
+	memcpy(whole.dun, bc->bc_dun, sizeof(whole.dun));
+	whole.data_unit_size = bc->bc_key->crypto_cfg.data_unit_size;
+	whole.encrypt = true;
 
-		/* Encrypt each data unit in this page */
-		for (j = 0; j < enc_bvec->bv_len; j += data_unit_size) {
-			blk_crypto_dun_to_iv(curr_dun, &iv);
-			if (crypto_wait_req(crypto_skcipher_encrypt(ciph_req),
-					    &wait)) {
-				i++;
-				src_bio->bi_status = BLK_STS_IOERR;
-				goto out_free_bounce_pages;
-			}
-			bio_crypt_dun_increment(curr_dun, 1);
-			src.offset += data_unit_size;
-			dst.offset += data_unit_size;
-		}
+	blk_st = blk_crypto_fallback_crypt(&whole);
+	if (blk_st != BLK_STS_OK) {
+		src_bio->bi_status = blk_st;
+		goto out_free_bounce_pages;
 	}
 
 	enc_bio->bi_private = src_bio;
@@ -351,14 +508,12 @@ static bool blk_crypto_fallback_encrypt_bio(struct bio **bio_ptr)
 	ret = true;
 
 	enc_bio = NULL;
-	goto out_free_ciph_req;
+	goto out_release_keyslot;
 
 out_free_bounce_pages:
 	while (i > 0)
 		mempool_free(enc_bio->bi_io_vec[--i].bv_page,
 			     blk_crypto_bounce_page_pool);
-out_free_ciph_req:
-	skcipher_request_free(ciph_req);
 out_release_keyslot:
 	blk_ksm_put_slot(slot);
 out_put_enc_bio:
@@ -379,15 +534,7 @@ static void blk_crypto_fallback_decrypt_bio(struct work_struct *work)
 	struct bio *bio = f_ctx->bio;
 	struct bio_crypt_ctx *bc = &f_ctx->crypt_ctx;
 	struct blk_ksm_keyslot *slot;
-	struct skcipher_request *ciph_req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
-	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
-	union blk_crypto_iv iv;
-	struct scatterlist sg;
-	struct bio_vec bv;
-	struct bvec_iter iter;
-	const int data_unit_size = bc->bc_key->crypto_cfg.data_unit_size;
-	unsigned int i;
+	struct blk_crypto_fallback_chunk whole;
 	blk_status_t blk_st;
 
 	/*
@@ -400,38 +547,18 @@ static void blk_crypto_fallback_decrypt_bio(struct work_struct *work)
 		goto out_no_keyslot;
 	}
 
-	/* and then allocate an skcipher_request for it */
-	if (!blk_crypto_alloc_cipher_req(slot, &ciph_req, &wait)) {
-		bio->bi_status = BLK_STS_RESOURCE;
-		goto out;
-	}
-
-	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
-	sg_init_table(&sg, 1);
-	skcipher_request_set_crypt(ciph_req, &sg, &sg, data_unit_size,
-				   iv.bytes);
-
-	/* Decrypt each segment in the bio */
-	__bio_for_each_segment(bv, bio, iter, f_ctx->crypt_iter) {
-		struct page *page = bv.bv_page;
+	whole.slot = slot;
+	whole.bio = bio;
+	whole.iter = f_ctx->crypt_iter;
+	whole.dst_bvecs = NULL;
+	memcpy(whole.dun, bc->bc_dun, sizeof(whole.dun));
+	whole.data_unit_size = bc->bc_key->crypto_cfg.data_unit_size;
+	whole.encrypt = false;
 
-		sg_set_page(&sg, page, data_unit_size, bv.bv_offset);
-
-		/* Decrypt each data unit in the segment */
-		for (i = 0; i < bv.bv_len; i += data_unit_size) {
-			blk_crypto_dun_to_iv(curr_dun, &iv);
-			if (crypto_wait_req(crypto_skcipher_decrypt(ciph_req),
-					    &wait)) {
-				bio->bi_status = BLK_STS_IOERR;
-				goto out;
-			}
-			bio_crypt_dun_increment(curr_dun, 1);
-			sg.offset += data_unit_size;
-		}
-	}
+	blk_st = blk_crypto_fallback_crypt(&whole);
+	if (blk_st != BLK_STS_OK)
+		bio->bi_status = blk_st;
 
-out:
-	skcipher_request_free(ciph_req);
 	blk_ksm_put_slot(slot);
 out_no_keyslot:
 	mempool_free(f_ctx, bio_fallback_crypt_ctx_pool);
@@ -558,11 +685,16 @@ static int blk_crypto_fallback_init(void)
 	if (!blk_crypto_wq)
 		goto fail_free_ksm;
 
+	blk_crypto_chunk_wq = alloc_workqueue("blk_crypto_chunk_wq",
+					      WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!blk_crypto_chunk_wq)
+		goto fail_free_wq;
+
 	blk_crypto_keyslots = kcalloc(blk_crypto_num_keyslots,
 				      sizeof(blk_crypto_keyslots[0]),
 				      GFP_KERNEL);
 	if (!blk_crypto_keyslots)
-		goto fail_free_wq;
+		goto fail_free_chunk_wq;
 
 	blk_crypto_bounce_page_pool =
 		mempool_create_page_pool(num_prealloc_bounce_pg, 0);
@@ -588,6 +720,8 @@ fail_free_bounce_page_pool:
 	mempool_destroy(blk_crypto_bounce_page_pool);
 fail_free_keyslots:
 	kfree(blk_crypto_keyslots);
+fail_free_chunk_wq:
+	destroy_workqueue(blk_crypto_chunk_wq);
 fail_free_wq:
 	destroy_workqueue(blk_crypto_wq);
 fail_free_ksm:
@@ -186,11 +186,20 @@ struct blk_ioprio {
 	struct rq_qos rqos;
 };
 
-static void blkcg_ioprio_track(struct rq_qos *rqos, struct request *rq,
-			       struct bio *bio)
+/**
+ * blkcg_set_ioprio - apply the cgroup I/O priority policy to a bio
+ * @bio: bio that is about to be merged or turned into a request
+ *
+ * Called before any merge attempt so that I/O schedulers see the final I/O
+ * priority class when looking up merge candidates.
+ */
+void blkcg_set_ioprio(struct bio *bio)
 {
 	struct ioprio_blkcg *blkcg = ioprio_blkcg_from_bio(bio);
 
+	if (!blkcg)
+		return;
+
 	/*
 	 * Except for IOPRIO_CLASS_NONE, higher I/O priority numbers
 	 * correspond to a lower priority. Hence, the max_t() below selects
@@ -213,7 +222,6 @@ static void blkcg_ioprio_exit(struct rq_qos *rqos)
 }
 
 static struct rq_qos_ops blkcg_ioprio_ops = {
-	.track	= blkcg_ioprio_track,
 	.exit	= blkcg_ioprio_exit,
 };
 
@@ -239,9 +247,9 @@ int blk_ioprio_init(struct request_queue *q)
 	rqos->q = q;
 
 	/*
-	 * Registering the rq-qos policy after activating the blk-cgroup
-	 * policy guarantees that ioprio_blkcg_from_bio(bio) != NULL in the
-	 * rq-qos callbacks.
+	 * The rq-qos policy only ties the lifetime of the blk-cgroup policy
+	 * activation to the request queue. Priorities are assigned by
+	 * blkcg_set_ioprio().
 	 */
 	rq_qos_add(q, rqos);
 
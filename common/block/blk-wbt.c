@@ -15,6 +15,12 @@
  *   scaling step of 0 if reads show up or the heavy writers finish. Unlike
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
+ * - Optionally, watch for flash devices that stall in internal garbage
+ *   collection: some writes in a window complete quickly while others take
+ *   far longer than the configured threshold. A saturated device instead
+ *   slows down all writes alike. While a stall is detected, background
+ *   writeback and discards are clamped to one request in flight, while
+ *   sync writes keep the full depth.
  *
  * Copyright (C) 2016 Jens Axboe
  *
@@ -73,6 +79,18 @@ enum {
 	 * information to scale up or down, scale up.
 	 */
 	RWB_UNKNOWN_BUMP	= 5,
+
+	/*
+	 * A window is considered a garbage collection stall if its slowest
+	 * write took at least this many times longer than its fastest one.
+	 */
+	RWB_GC_SPREAD		= 8,
+
+	/*
+	 * Number of default windows to keep background writeback clamped
+	 * after the last window that looked like a stall.
+	 */
+	RWB_GC_HOLD_WINDOWS	= 5,
 };
 
 static inline bool rwb_enabled(struct rq_wb *rwb)
@@ -91,6 +109,12 @@ static void wb_timestamp(struct rq_wb *rwb, unsigned long *var)
 	}
 }
 
+static bool wbt_gc_stalled(struct rq_wb *rwb)
+{
+	return rwb->gc_lat_nsec &&
+		time_before(jiffies, READ_ONCE(rwb->gc_stall_until));
+}
+
 /*
  * If a task was rate throttled in balance_dirty_pages() within the last
  * second or so, use that to indicate a higher cleaning rate.
@@ -350,6 +374,26 @@ static void rwb_arm_timer(struct rq_wb *rwb)
 	blk_stat_activate_nsecs(rwb->cb, rwb->cur_win_nsec);
 }
 
+static void wbt_check_gc_stall(struct rq_wb *rwb, struct blk_rq_stat *stat)
+{
+	struct blk_rq_stat *write = &stat[WRITE];
+
+	if (!rwb->gc_lat_nsec || write->nr_samples < RWB_MIN_WRITE_SAMPLES)
+		return;
+
+	if (write->max < rwb->gc_lat_nsec ||
+	    write->max < RWB_GC_SPREAD * write->min)
+		return;
+
+	if (!wbt_gc_stalled(rwb)) {
+		rwb->gc_stalls++;
+		trace_wbt_lat(rwb->rqos.q->backing_dev_info, write->max);
+		rwb_trace_step(rwb, tracepoint_string("gc stall"));
+	}
+	WRITE_ONCE(rwb->gc_stall_until, jiffies +
+		   nsecs_to_jiffies(rwb->win_nsec * RWB_GC_HOLD_WINDOWS));
+}
+
 static void wb_timer_fn(struct blk_stat_callback *cb)
 {
 	struct rq_wb *rwb = cb->data;
@@ -358,6 +402,7 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	int status;
 
 	status = latency_exceeded(rwb, cb->stat);
+	wbt_check_gc_stall(rwb, cb->stat);
 
 	trace_wbt_timer(rwb->rqos.q->backing_dev_info, status, rqd->scale_step,
 			inflight);
@@ -437,6 +482,24 @@ void wbt_set_min_lat(struct request_queue *q, u64 val)
 	wbt_update_limits(RQWB(rqos));
 }
 
+u64 wbt_get_gc_lat(struct request_queue *q)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	if (!rqos)
+		return 0;
+	return RQWB(rqos)->gc_lat_nsec;
+}
+
+void wbt_set_gc_lat(struct request_queue *q, u64 val)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	if (!rqos)
+		return;
+	RQWB(rqos)->gc_lat_nsec = val;
+	WRITE_ONCE(RQWB(rqos)->gc_stall_until, jiffies);
+	rwb_wake_all(RQWB(rqos));
+}
+
 
 static bool close_io(struct rq_wb *rwb)
 {
@@ -460,7 +523,7 @@ static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
 		return UINT_MAX;
 
 	if ((rw & REQ_OP_MASK) == REQ_OP_DISCARD)
-		return rwb->wb_background;
+		return wbt_gc_stalled(rwb) ? 1 : rwb->wb_background;
 
 	/*
 	 * At this point we know it's a buffered write. If this is
@@ -472,7 +535,15 @@ static inline unsigned int get_limit(struct rq_wb *rwb, unsigned long rw)
 	 */
 	if ((rw & REQ_HIPRIO) || wb_recent_wait(rwb) || current_is_kswapd())
 		limit = rwb->rq_depth.max_depth;
-	else if ((rw & REQ_BACKGROUND) || close_io(rwb)) {
+	else if (!(rw & REQ_SYNC) && wbt_gc_stalled(rwb)) {
+		/*
+		 * Don't feed more async writes to a device that is busy with
+		 * garbage collection, so that sync writes and reads find it
+		 * idle.  fsync and WB_SYNC_ALL writeback (REQ_SYNC) keep
+		 * their normal limits.
+		 */
+		limit = 1;
+	} else if ((rw & REQ_BACKGROUND) || close_io(rwb)) {
 		/*
 		 * If less than 100ms since we completed unrelated IO,
 		 * limit us to half the depth for background writeback.
@@ -787,6 +858,33 @@ static int wbt_background_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int wbt_gc_lat_nsec_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%llu\n", rwb->gc_lat_nsec);
+	return 0;
+}
+
+static int wbt_gc_stalls_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%u\n", rwb->gc_stalls);
+	return 0;
+}
+
+static int wbt_gc_stalled_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+
+	seq_printf(m, "%d\n", wbt_gc_stalled(rwb));
+	return 0;
+}
+
 static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"curr_win_nsec", 0400, wbt_curr_win_nsec_show},
 	{"enabled", 0400, wbt_enabled_show},
@@ -796,6 +894,9 @@ static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"unknown_cnt", 0400, wbt_unknown_cnt_show},
 	{"wb_normal", 0400, wbt_normal_show},
 	{"wb_background", 0400, wbt_background_show},
+	{"gc_lat_nsec", 0400, wbt_gc_lat_nsec_show},
+	{"gc_stalls", 0400, wbt_gc_stalls_show},
+	{"gc_stalled", 0400, wbt_gc_stalled_show},
 	{},
 };
 #endif
@@ -836,6 +937,7 @@ int wbt_init(struct request_queue *q)
 	rwb->rqos.ops = &wbt_rqos_ops;
 	rwb->rqos.q = q;
 	rwb->last_comp = rwb->last_issue = jiffies;
+	rwb->gc_stall_until = jiffies;
 	rwb->win_nsec = RWB_WINDOW_NSEC;
 	rwb->enable_state = WBT_STATE_ON_DEFAULT;
 	rwb->wc = test_bit(QUEUE_FLAG_WC, &q->queue_flags);
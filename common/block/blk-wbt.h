@@ -65,6 +65,15 @@ struct rq_wb {
 	unsigned long last_issue;		/* last non-throttled issue */
 	unsigned long last_comp;		/* last non-throttled comp */
 	unsigned long min_lat_nsec;
+
+	/*
+	 * Flash garbage collection stall detection. While a stall is in
+	 * progress, background writeback is clamped to a single request.
+	 */
+	u64 gc_lat_nsec;			/* stall threshold, 0 is off */
+	unsigned long gc_stall_until;		/* jiffies */
+	unsigned int gc_stalls;			/* number of stall episodes */
+
 	struct rq_qos rqos;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 	struct rq_depth rq_depth;
@@ -95,6 +104,9 @@ void wbt_enable_default(struct request_queue *);
 u64 wbt_get_min_lat(struct request_queue *q);
 void wbt_set_min_lat(struct request_queue *q, u64 val);
 
+u64 wbt_get_gc_lat(struct request_queue *q);
+void wbt_set_gc_lat(struct request_queue *q, u64 val);
+
 void wbt_set_write_cache(struct request_queue *, bool);
 
 u64 wbt_default_latency_nsec(struct request_queue *);
@@ -124,6 +136,13 @@ static inline u64 wbt_get_min_lat(struct request_queue *q)
 static inline void wbt_set_min_lat(struct request_queue *q, u64 val)
 {
 }
+static inline u64 wbt_get_gc_lat(struct request_queue *q)
+{
+	return 0;
+}
+static inline void wbt_set_gc_lat(struct request_queue *q, u64 val)
+{
+}
 static inline u64 wbt_default_latency_nsec(struct request_queue *q)
 {
 	return 0;
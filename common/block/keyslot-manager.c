@@ -24,6 +24,10 @@
  *
  * Upper layers will call blk_ksm_get_slot_for_key() to program a
  * key into some slot in the inline encryption hardware.
+ *
+ * Looking up a slot that already holds the key is lockless: the key-to-slot
+ * hash table is walked under RCU and the slot is pinned with its refcount.
+ * Only programming and evicting keys take ksm->lock.
  */
 
 #define pr_fmt(fmt) "blk-crypto: " fmt
@@ -33,6 +37,7 @@
 #include <linux/atomic.h>
 #include <linux/mutex.h>
 #include <linux/pm_runtime.h>
+#include <linux/rculist.h>
 #include <linux/wait.h>
 #include <linux/blkdev.h>
 
@@ -168,14 +173,39 @@ blk_ksm_hash_bucket_for_key(struct blk_keyslot_manager *ksm,
 	return &ksm->slot_hashtable[hash_ptr(key, ksm->log_slot_ht_size)];
 }
 
-static void blk_ksm_remove_slot_from_lru_list(struct blk_ksm_keyslot *slot)
+/*
+ * Try to take a reference to @slot, provided that it's still programmed with
+ * @key.  A slot that is already in use can't be reprogrammed, so that case
+ * only needs an atomic increment.  Taking the first reference has to remove
+ * the slot from the LRU list, which is done under idle_slots_lock; the key is
+ * rechecked under that lock since claiming an idle slot for programming also
+ * happens under it.
+ */
+static bool blk_ksm_tryget_slot(struct blk_ksm_keyslot *slot,
+				const struct blk_crypto_key *key)
 {
 	struct blk_keyslot_manager *ksm = slot->ksm;
 	unsigned long flags;
+	bool ret = false;
+
+	if (atomic_inc_not_zero(&slot->slot_refs)) {
+		if (likely(READ_ONCE(slot->key) == key))
+			return true;
+		/* Raced with the slot being reprogrammed for another key */
+		blk_ksm_put_slot(slot);
+		return false;
+	}
 
 	spin_lock_irqsave(&ksm->idle_slots_lock, flags);
-	list_del(&slot->idle_slot_node);
+	if (slot->key == key) {
+		if (atomic_inc_return(&slot->slot_refs) == 1) {
+			/* Took first reference to this slot; remove it from LRU list */
+			list_del(&slot->idle_slot_node);
+		}
+		ret = true;
+	}
 	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+	return ret;
 }
 
 static struct blk_ksm_keyslot *blk_ksm_find_keyslot(
@@ -185,13 +215,19 @@ static struct blk_ksm_keyslot *blk_ksm_find_keyslot(
 	const struct hlist_head *head = blk_ksm_hash_bucket_for_key(ksm, key);
 	struct blk_ksm_keyslot *slotp;
 
-	hlist_for_each_entry(slotp, head, hash_node) {
-		if (slotp->key == key)
+	hlist_for_each_entry_rcu(slotp, head, hash_node,
+				 lockdep_is_held(&ksm->lock)) {
+		if (READ_ONCE(slotp->key) == key)
 			return slotp;
 	}
 	return NULL;
 }
 
+/*
+ * Find the slot holding @key and take a reference to it.  May be called under
+ * rcu_read_lock() or with ksm->lock held.  Under RCU, a concurrent
+ * reprogramming may make the lookup miss; callers then retry under ksm->lock.
+ */
 static struct blk_ksm_keyslot *blk_ksm_find_and_grab_keyslot(
 					struct blk_keyslot_manager *ksm,
 					const struct blk_crypto_key *key)
@@ -199,12 +235,33 @@ static struct blk_ksm_keyslot *blk_ksm_find_and_grab_keyslot(
 	struct blk_ksm_keyslot *slot;
 
 	slot = blk_ksm_find_keyslot(ksm, key);
-	if (!slot)
+	if (!slot || !blk_ksm_tryget_slot(slot, key))
 		return NULL;
-	if (atomic_inc_return(&slot->slot_refs) == 1) {
-		/* Took first reference to this slot; remove it from LRU list */
-		blk_ksm_remove_slot_from_lru_list(slot);
+	return slot;
+}
+
+/*
+ * Take the least recently used idle slot for programming a new key.  The slot
+ * is unhashed and taken off the LRU list under idle_slots_lock, so lockless
+ * lookups can no longer grab it for its old key.  Called with ksm->lock held
+ * for writing and idle_slots non-empty.
+ */
+static struct blk_ksm_keyslot *blk_ksm_claim_idle_slot(
+					struct blk_keyslot_manager *ksm)
+{
+	struct blk_ksm_keyslot *slot;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ksm->idle_slots_lock, flags);
+	slot = list_first_entry(&ksm->idle_slots, struct blk_ksm_keyslot,
+				idle_slot_node);
+	list_del(&slot->idle_slot_node);
+	if (slot->key) {
+		hlist_del_rcu(&slot->hash_node);
+		WRITE_ONCE(slot->key, NULL);
 	}
+	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+
 	return slot;
 }
 
@@ -225,7 +282,8 @@ EXPORT_SYMBOL_GPL(blk_ksm_get_slot_idx);
  * exists, return it with incremented refcount.  Otherwise, wait for a keyslot
  * to become idle and program it.
  *
- * Context: Process context. Takes and releases ksm->lock.
+ * Context: Process context. Takes and releases ksm->lock, unless the key is
+ *	    already programmed into a slot.
  * Return: BLK_STS_OK on success (and keyslot is set to the pointer of the
  *	   allocated keyslot), or some other blk_status_t otherwise (and
  *	   keyslot is set to NULL).
@@ -243,9 +301,9 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 	if (blk_ksm_is_passthrough(ksm))
 		return BLK_STS_OK;
 
-	down_read(&ksm->lock);
+	rcu_read_lock();
 	slot = blk_ksm_find_and_grab_keyslot(ksm, key);
-	up_read(&ksm->lock);
+	rcu_read_unlock();
 	if (slot)
 		goto success;
 
@@ -269,26 +327,28 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 			   !list_empty(&ksm->idle_slots));
 	}
 
-	slot = list_first_entry(&ksm->idle_slots, struct blk_ksm_keyslot,
-				idle_slot_node);
+	slot = blk_ksm_claim_idle_slot(ksm);
 	slot_idx = blk_ksm_get_slot_idx(slot);
 
 	err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot_idx);
 	if (err) {
+		/* The slot holds no key now; make it the first to be reused */
+		spin_lock_irq(&ksm->idle_slots_lock);
+		list_add(&slot->idle_slot_node, &ksm->idle_slots);
+		spin_unlock_irq(&ksm->idle_slots_lock);
 		wake_up(&ksm->idle_slots_wait_queue);
 		blk_ksm_hw_exit(ksm);
 		return errno_to_blk_status(err);
 	}
 
-	/* Move this slot to the hash list for the new key. */
-	if (slot->key)
-		hlist_del(&slot->hash_node);
-	slot->key = key;
-	hlist_add_head(&slot->hash_node, blk_ksm_hash_bucket_for_key(ksm, key));
-
-	atomic_set(&slot->slot_refs, 1);
-
-	blk_ksm_remove_slot_from_lru_list(slot);
+	/*
+	 * Publish the key before the reference, so that a lockless lookup
+	 * that takes a second reference sees the new key.
+	 */
+	WRITE_ONCE(slot->key, key);
+	atomic_set_release(&slot->slot_refs, 1);
+	hlist_add_head_rcu(&slot->hash_node,
+			   blk_ksm_hash_bucket_for_key(ksm, key));
 
 	blk_ksm_hw_exit(ksm);
 success:
@@ -394,8 +454,10 @@ out_remove:
 	 * Callers free the key even on error, so unlink the key from the hash
 	 * table and clear slot->key even on error.
 	 */
-	hlist_del(&slot->hash_node);
-	slot->key = NULL;
+	spin_lock_irq(&ksm->idle_slots_lock);
+	hlist_del_rcu(&slot->hash_node);
+	WRITE_ONCE(slot->key, NULL);
+	spin_unlock_irq(&ksm->idle_slots_lock);
 out:
 	blk_ksm_hw_exit(ksm);
 	return err;
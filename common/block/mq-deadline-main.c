@@ -55,9 +55,18 @@ enum dd_prio {
 
 enum { DD_PRIO_COUNT = 3 };
 
+/*
+ * Number of completion latency histogram buckets. Bucket 0 counts requests
+ * that completed in less than one microsecond and bucket i > 0 counts
+ * latencies in the range [2^(i-1), 2^i) microseconds. The last bucket also
+ * counts all larger latencies.
+ */
+enum { DD_LAT_BUCKETS = 24 };
+
 /* I/O statistics for all I/O priorities (enum dd_prio). */
 struct io_stats {
 	struct io_stats_per_prio stats[DD_PRIO_COUNT];
+	local_t lat[DD_PRIO_COUNT][DD_LAT_BUCKETS];
 };
 
 /*
@@ -130,6 +139,21 @@ struct deadline_data {
 	sum;								\
 })
 
+/*
+ * Record the latency between allocation and completion of a request that has
+ * been dispatched with I/O priority 'prio'.
+ */
+static void dd_count_lat(struct deadline_data *dd, enum dd_prio prio,
+			 u64 lat_ns)
+{
+	struct io_stats *io_stats = get_cpu_ptr(dd->stats);
+	unsigned int bucket = fls64(div_u64(lat_ns, NSEC_PER_USEC));
+
+	local_inc(&io_stats->lat[prio][min_t(unsigned int, bucket,
+					     DD_LAT_BUCKETS - 1)]);
+	put_cpu_ptr(io_stats);
+}
+
 /* Maps an I/O priority class to a deadline scheduler priority. */
 static const enum dd_prio ioprio_class_to_prio[] = {
 	[IOPRIO_CLASS_NONE]	= DD_BE_PRIO,
@@ -833,6 +857,9 @@ static void dd_finish_request(struct request *rq)
 	dd_count(dd, completed, prio);
 	ddcg_count(blkcg, completed, ioprio_class);
 
+	if ((rq->rq_flags & RQF_STARTED) && rq->start_time_ns)
+		dd_count_lat(dd, prio, ktime_get_ns() - rq->start_time_ns);
+
 	if (blk_queue_is_zoned(q)) {
 		unsigned long flags;
 
@@ -1047,6 +1074,61 @@ static int dd_owned_by_driver_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+/*
+ * Returns the upper bound in microseconds of the histogram bucket that holds
+ * the request at position 'permille' / 1000 of all 'total' samples.
+ */
+static u64 dd_lat_percentile(const u64 *hist, u64 total, unsigned int permille)
+{
+	u64 target = div_u64(total * permille + 999, 1000);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < DD_LAT_BUCKETS - 1; i++) {
+		seen += hist[i];
+		if (seen >= target)
+			break;
+	}
+	return 1ULL << i;
+}
+
+static int dd_latency_show(void *data, struct seq_file *m)
+{
+	static const char *const prio_name[] = {
+		[DD_RT_PRIO]	= "RT",
+		[DD_BE_PRIO]	= "BE",
+		[DD_IDLE_PRIO]	= "IDLE",
+	};
+	struct request_queue *q = data;
+	struct deadline_data *dd = q->elevator->elevator_data;
+	enum dd_prio prio;
+
+	for (prio = 0; prio <= DD_PRIO_MAX; prio++) {
+		u64 hist[DD_LAT_BUCKETS] = { };
+		u64 total = 0;
+		unsigned int cpu, i;
+
+		for_each_present_cpu(cpu) {
+			struct io_stats *io_stats = per_cpu_ptr(dd->stats, cpu);
+
+			for (i = 0; i < DD_LAT_BUCKETS; i++)
+				hist[i] += local_read(&io_stats->lat[prio][i]);
+		}
+		for (i = 0; i < DD_LAT_BUCKETS; i++)
+			total += hist[i];
+
+		seq_printf(m, "%s samples=%llu", prio_name[prio], total);
+		if (total)
+			seq_printf(m, " p50=%lluus p90=%lluus p99=%lluus p999=%lluus",
+				   dd_lat_percentile(hist, total, 500),
+				   dd_lat_percentile(hist, total, 900),
+				   dd_lat_percentile(hist, total, 990),
+				   dd_lat_percentile(hist, total, 999));
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
 #define DEADLINE_DISPATCH_ATTR(prio)					\
 static void *deadline_dispatch##prio##_start(struct seq_file *m,	\
 					     loff_t *pos)		\
@@ -1117,6 +1199,7 @@ static const struct blk_mq_debugfs_attr deadline_queue_debugfs_attrs[] = {
 	{"dispatch2", 0400, .seq_ops = &deadline_dispatch2_seq_ops},
 	{"owned_by_driver", 0400, dd_owned_by_driver_show},
 	{"queued", 0400, dd_queued_show},
+	{"latency", 0400, dd_latency_show},
 	{},
 };
 #undef DEADLINE_QUEUE_DDIR_ATTRS
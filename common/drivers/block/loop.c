@@ -915,8 +915,14 @@ static void loop_config_discard(struct loop_device *lo)
 
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_hw_queues; i++) {
+		struct loop_hw_queue *lq = &lo->hw_queues[i];
+
+		kthread_flush_worker(&lq->worker);
+		kthread_stop(lq->worker_task);
+	}
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -927,13 +933,29 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
-		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+	unsigned int i;
+
+	for (i = 0; i < lo->nr_hw_queues; i++) {
+		struct loop_hw_queue *lq = &lo->hw_queues[i];
+
+		kthread_init_worker(&lq->worker);
+		if (lo->nr_hw_queues == 1)
+			lq->worker_task = kthread_run(loop_kthread_worker_fn,
+					&lq->worker, "loop%d", lo->lo_number);
+		else
+			lq->worker_task = kthread_run(loop_kthread_worker_fn,
+					&lq->worker, "loop%d-%u",
+					lo->lo_number, i);
+		if (IS_ERR(lq->worker_task))
+			goto out_stop;
+		set_user_nice(lq->worker_task, MIN_NICE);
+	}
 	return 0;
+
+out_stop:
+	while (i--)
+		kthread_stop(lo->hw_queues[i].worker_task);
+	return -ENOMEM;
 }
 
 static void loop_update_rotational(struct loop_device *lo)
@@ -1953,6 +1975,9 @@ module_param(max_loop, int, 0444);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0444);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+static unsigned int nr_hw_queues;
+module_param(nr_hw_queues, uint, 0444);
+MODULE_PARM_DESC(nr_hw_queues, "Number of hardware queues per loop device (default: one per 4 online CPUs)");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1997,9 +2022,11 @@ EXPORT_SYMBOL(loop_unregister_transfer);
 static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
+	struct loop_hw_queue *lq = hctx->driver_data;
 	struct request *rq = bd->rq;
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	struct loop_device *lo = rq->q->queuedata;
+	unsigned long flags;
 
 	blk_mq_start_request(rq);
 
@@ -2025,11 +2052,25 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	} else
 #endif
 		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+
+	spin_lock_irqsave(&lq->lock, flags);
+	list_add_tail(&cmd->list_entry, &lq->cmd_list);
+	spin_unlock_irqrestore(&lq->lock, flags);
+
+	/* The rest of the batch will follow, kick the worker once for all */
+	if (bd->last)
+		kthread_queue_work(&lq->worker, &lq->work);
 
 	return BLK_STS_OK;
 }
 
+static void loop_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	struct loop_hw_queue *lq = hctx->driver_data;
+
+	kthread_queue_work(&lq->worker, &lq->work);
+}
+
 static void loop_handle_cmd(struct loop_cmd *cmd)
 {
 	struct request *rq = blk_mq_rq_from_pdu(cmd);
@@ -2057,27 +2098,69 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 
 static void loop_queue_work(struct kthread_work *work)
 {
-	struct loop_cmd *cmd =
-		container_of(work, struct loop_cmd, work);
+	struct loop_hw_queue *lq =
+		container_of(work, struct loop_hw_queue, work);
+	struct loop_cmd *cmd;
+	struct blk_plug plug;
+	LIST_HEAD(cmd_list);
 
-	loop_handle_cmd(cmd);
+	spin_lock_irq(&lq->lock);
+	list_splice_init(&lq->cmd_list, &cmd_list);
+	spin_unlock_irq(&lq->lock);
+
+	/*
+	 * Submit the whole batch under one plug, so that the kiocbs of
+	 * direct I/O requests reach the backing device together.
+	 */
+	blk_start_plug(&plug);
+	while (!list_empty(&cmd_list)) {
+		cmd = list_first_entry(&cmd_list, struct loop_cmd, list_entry);
+		list_del_init(&cmd->list_entry);
+		loop_handle_cmd(cmd);
+	}
+	blk_finish_plug(&plug);
 }
 
-static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
-		unsigned int hctx_idx, unsigned int numa_node)
+static int loop_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+		unsigned int hctx_idx)
 {
-	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
+	struct loop_device *lo = data;
 
-	kthread_init_work(&cmd->work, loop_queue_work);
+	hctx->driver_data = &lo->hw_queues[hctx_idx];
 	return 0;
 }
 
 static const struct blk_mq_ops loop_mq_ops = {
 	.queue_rq       = loop_queue_rq,
-	.init_request	= loop_init_request,
+	.commit_rqs	= loop_commit_rqs,
+	.init_hctx	= loop_init_hctx,
 	.complete	= lo_complete_rq,
 };
 
+static int loop_alloc_hw_queues(struct loop_device *lo)
+{
+	unsigned int i;
+
+	lo->nr_hw_queues = nr_hw_queues;
+	if (!lo->nr_hw_queues)
+		lo->nr_hw_queues = DIV_ROUND_UP(num_online_cpus(), 4);
+	lo->nr_hw_queues = min(lo->nr_hw_queues, nr_cpu_ids);
+
+	lo->hw_queues = kcalloc(lo->nr_hw_queues, sizeof(*lo->hw_queues),
+				GFP_KERNEL);
+	if (!lo->hw_queues)
+		return -ENOMEM;
+
+	for (i = 0; i < lo->nr_hw_queues; i++) {
+		struct loop_hw_queue *lq = &lo->hw_queues[i];
+
+		spin_lock_init(&lq->lock);
+		INIT_LIST_HEAD(&lq->cmd_list);
+		kthread_init_work(&lq->work, loop_queue_work);
+	}
+	return 0;
+}
+
 static int loop_add(struct loop_device **l, int i)
 {
 	struct loop_device *lo;
@@ -2103,9 +2186,13 @@ static int loop_add(struct loop_device **l, int i)
 		goto out_free_dev;
 	i = err;
 
+	err = loop_alloc_hw_queues(lo);
+	if (err)
+		goto out_free_idr;
+
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = lo->nr_hw_queues;
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
@@ -2115,7 +2202,7 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = blk_mq_alloc_tag_set(&lo->tag_set);
 	if (err)
-		goto out_free_idr;
+		goto out_free_hw_queues;
 
 	lo->lo_queue = blk_mq_init_queue(&lo->tag_set);
 	if (IS_ERR(lo->lo_queue)) {
@@ -2177,6 +2264,8 @@ out_free_queue:
 	blk_cleanup_queue(lo->lo_queue);
 out_cleanup_tags:
 	blk_mq_free_tag_set(&lo->tag_set);
+out_free_hw_queues:
+	kfree(lo->hw_queues);
 out_free_idr:
 	idr_remove(&loop_index_idr, i);
 out_free_dev:
@@ -2191,6 +2280,7 @@ static void loop_remove(struct loop_device *lo)
 	blk_cleanup_queue(lo->lo_queue);
 	blk_mq_free_tag_set(&lo->tag_set);
 	put_disk(lo->lo_disk);
+	kfree(lo->hw_queues);
 	kfree(lo);
 }
 
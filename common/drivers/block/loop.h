@@ -26,6 +26,19 @@ enum {
 
 struct loop_func_table;
 
+/*
+ * Each hw queue has its own worker thread. Commands are collected on
+ * cmd_list by ->queue_rq and the worker is only kicked once per dispatch
+ * batch, so it can submit the whole batch under one plug.
+ */
+struct loop_hw_queue {
+	struct kthread_worker	worker;
+	struct task_struct	*worker_task;
+	struct kthread_work	work;
+	spinlock_t		lock;
+	struct list_head	cmd_list;
+};
+
 struct loop_device {
 	int		lo_number;
 	atomic_t	lo_refcnt;
@@ -54,8 +67,8 @@ struct loop_device {
 
 	spinlock_t		lo_lock;
 	int			lo_state;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct loop_hw_queue	*hw_queues;
+	unsigned int		nr_hw_queues;
 	bool			use_dio;
 	bool			sysfs_inited;
 
@@ -65,7 +78,7 @@ struct loop_device {
 };
 
 struct loop_cmd {
-	struct kthread_work work;
+	struct list_head list_entry;
 	bool use_aio; /* use AIO interface to handle I/O */
 	atomic_t ref; /* only for aio */
 	long ret;
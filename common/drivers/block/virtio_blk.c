@@ -26,6 +26,10 @@ static DEFINE_IDA(vd_index_ida);
 
 static struct workqueue_struct *virtblk_wq;
 
+static unsigned int poll_queues;
+module_param(poll_queues, uint, 0444);
+MODULE_PARM_DESC(poll_queues, "The number of dedicated virtqueues for polling I/O");
+
 struct virtio_blk_vq {
 	struct virtqueue *vq;
 	spinlock_t lock;
@@ -68,12 +72,15 @@ struct virtio_blk {
 
 	/* num of vqs */
 	int num_vqs;
+	int io_queues[HCTX_MAX_TYPES];
 	struct virtio_blk_vq *vqs;
 };
 
 struct virtblk_req {
 	struct virtio_blk_outhdr out_hdr;
 	u8 status;
+	/* Links used buffers reaped together for completion */
+	struct list_head done_list;
 	struct scatterlist sg[];
 };
 
@@ -171,33 +178,78 @@ static inline void virtblk_request_done(struct request *req)
 	blk_mq_end_request(req, virtblk_result(vbr));
 }
 
+/*
+ * Moves every used buffer of @vq onto @done.  Must be called with the vq
+ * lock held; the requests are completed by virtblk_complete_batch() once
+ * the lock has been dropped.
+ */
+static int virtblk_reap_used(struct virtqueue *vq, struct list_head *done)
+{
+	struct virtblk_req *vbr;
+	unsigned int len;
+	int found = 0;
+
+	while ((vbr = virtqueue_get_buf(vq, &len)) != NULL) {
+		list_add_tail(&vbr->done_list, done);
+		found++;
+	}
+
+	return found;
+}
+
+static void virtblk_complete_batch(struct virtio_blk *vblk,
+				   struct list_head *done)
+{
+	struct virtblk_req *vbr, *next;
+
+	list_for_each_entry_safe(vbr, next, done, done_list) {
+		struct request *req = blk_mq_rq_from_pdu(vbr);
+
+		list_del(&vbr->done_list);
+		if (likely(!blk_should_fake_timeout(req->q)))
+			blk_mq_complete_request(req);
+	}
+
+	/* In case queue is stopped waiting for more buffers. */
+	blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
+}
+
 static void virtblk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
-	bool req_done = false;
 	int qid = vq->index;
-	struct virtblk_req *vbr;
 	unsigned long flags;
-	unsigned int len;
+	LIST_HEAD(done);
+	int found = 0;
 
 	spin_lock_irqsave(&vblk->vqs[qid].lock, flags);
 	do {
 		virtqueue_disable_cb(vq);
-		while ((vbr = virtqueue_get_buf(vblk->vqs[qid].vq, &len)) != NULL) {
-			struct request *req = blk_mq_rq_from_pdu(vbr);
-
-			if (likely(!blk_should_fake_timeout(req->q)))
-				blk_mq_complete_request(req);
-			req_done = true;
-		}
+		found += virtblk_reap_used(vq, &done);
 		if (unlikely(virtqueue_is_broken(vq)))
 			break;
 	} while (!virtqueue_enable_cb(vq));
-
-	/* In case queue is stopped waiting for more buffers. */
-	if (req_done)
-		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
+
+	if (found)
+		virtblk_complete_batch(vblk, &done);
+}
+
+static int virtblk_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtio_blk_vq *vq = &vblk->vqs[hctx->queue_num];
+	unsigned long flags;
+	LIST_HEAD(done);
+	int found;
+
+	spin_lock_irqsave(&vq->lock, flags);
+	found = virtblk_reap_used(vq->vq, &done);
+	spin_unlock_irqrestore(&vq->lock, flags);
+
+	if (found)
+		virtblk_complete_batch(vblk, &done);
+	return found;
 }
 
 static void virtio_commit_rqs(struct blk_mq_hw_ctx *hctx)
@@ -498,6 +550,7 @@ static int init_vq(struct virtio_blk *vblk)
 	const char **names;
 	struct virtqueue **vqs;
 	unsigned short num_vqs;
+	unsigned int num_poll_vqs;
 	struct virtio_device *vdev = vblk->vdev;
 	struct irq_affinity desc = { 0, };
 
@@ -509,6 +562,18 @@ static int init_vq(struct virtio_blk *vblk)
 
 	num_vqs = min_t(unsigned int, nr_cpu_ids, num_vqs);
 
+	/* Keep at least one interrupt driven queue for everything else. */
+	num_poll_vqs = min_t(unsigned int, poll_queues, num_vqs - 1);
+
+	vblk->io_queues[HCTX_TYPE_DEFAULT] = num_vqs - num_poll_vqs;
+	vblk->io_queues[HCTX_TYPE_READ] = 0;
+	vblk->io_queues[HCTX_TYPE_POLL] = num_poll_vqs;
+
+	dev_info(&vdev->dev, "%d/%d/%d default/read/poll queues\n",
+		 vblk->io_queues[HCTX_TYPE_DEFAULT],
+		 vblk->io_queues[HCTX_TYPE_READ],
+		 vblk->io_queues[HCTX_TYPE_POLL]);
+
 	vblk->vqs = kmalloc_array(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
 	if (!vblk->vqs)
 		return -ENOMEM;
@@ -521,12 +586,19 @@ static int init_vq(struct virtio_blk *vblk)
 		goto out;
 	}
 
-	for (i = 0; i < num_vqs; i++) {
+	for (i = 0; i < num_vqs - num_poll_vqs; i++) {
 		callbacks[i] = virtblk_done;
 		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req.%d", i);
 		names[i] = vblk->vqs[i].name;
 	}
 
+	/* Poll queues are reaped from blk_poll() and get no interrupt. */
+	for (; i < num_vqs; i++) {
+		callbacks[i] = NULL;
+		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req_poll.%d", i);
+		names[i] = vblk->vqs[i].name;
+	}
+
 	/* Discover virtqueues and write information to configuration.  */
 	err = virtio_find_vqs(vdev, num_vqs, vqs, callbacks, names, &desc);
 	if (err)
@@ -683,9 +755,29 @@ static int virtblk_init_request(struct blk_mq_tag_set *set, struct request *rq,
 static int virtblk_map_queues(struct blk_mq_tag_set *set)
 {
 	struct virtio_blk *vblk = set->driver_data;
+	int i, qoff;
+
+	for (i = 0, qoff = 0; i < set->nr_maps; i++) {
+		struct blk_mq_queue_map *map = &set->map[i];
+
+		map->nr_queues = vblk->io_queues[i];
+		map->queue_offset = qoff;
+		qoff += map->nr_queues;
+
+		if (map->nr_queues == 0)
+			continue;
 
-	return blk_mq_virtio_map_queues(&set->map[HCTX_TYPE_DEFAULT],
-					vblk->vdev, 0);
+		/*
+		 * Regular queues have interrupt vectors whose affinity we
+		 * follow, poll queues have none and are spread over all CPUs.
+		 */
+		if (i == HCTX_TYPE_POLL)
+			blk_mq_map_queues(map);
+		else
+			blk_mq_virtio_map_queues(map, vblk->vdev, 0);
+	}
+
+	return 0;
 }
 
 static const struct blk_mq_ops virtio_mq_ops = {
@@ -694,6 +786,7 @@ static const struct blk_mq_ops virtio_mq_ops = {
 	.complete	= virtblk_request_done,
 	.init_request	= virtblk_init_request,
 	.map_queues	= virtblk_map_queues,
+	.poll		= virtblk_poll,
 };
 
 static unsigned int virtblk_queue_depth;
@@ -776,6 +869,9 @@ static int virtblk_probe(struct virtio_device *vdev)
 		sizeof(struct scatterlist) * sg_elems;
 	vblk->tag_set.driver_data = vblk;
 	vblk->tag_set.nr_hw_queues = vblk->num_vqs;
+	vblk->tag_set.nr_maps = 1;
+	if (vblk->io_queues[HCTX_TYPE_POLL])
+		vblk->tag_set.nr_maps = HCTX_MAX_TYPES;
 
 	err = blk_mq_alloc_tag_set(&vblk->tag_set);
 	if (err)
@@ -7,12 +7,19 @@
 #include "dm.h"
 #include "dm-core.h"
 
+#include <linux/blkdev.h>
 #include <linux/crc32.h>
 #include <linux/dm-bufio.h>
 #include <linux/module.h>
 
 #define DM_MSG_PREFIX "bow"
 
+/*
+ * Largest run of adjacent queued writes that is prepared as one range, so
+ * that the backup of the run is done with one read and one write
+ */
+#define MAX_WRITE_RUN (1 << 20)
+
 struct log_entry {
 	u64 source;
 	u64 dest;
@@ -92,6 +99,15 @@ struct bow_context {
 	struct log_sector *log_sector;
 	struct list_head trimmed_list;
 	bool forward_trims;
+
+	/* Writes waiting for their ranges to be backed up */
+	spinlock_t pending_lock;
+	struct bio_list pending_writes;
+	struct work_struct write_work;
+
+	/* Backup statistics, protected by ranges_lock */
+	u64 backup_bytes;
+	unsigned long checkpoint_start;
 };
 
 sector_t range_top(struct bow_range *br)
@@ -285,6 +301,10 @@ static int copy_data(struct bow_context const *bc,
 	if (checksum)
 		*checksum = sector_to_page(bc, source->sector);
 
+	/* Issue the reads for the whole range up front */
+	dm_bufio_prefetch(bc->bufio, sector_to_page(bc, source->sector),
+			  range_size(source) >> bc->block_shift);
+
 	for (i = 0; i < range_size(source) >> bc->block_shift; ++i) {
 		struct dm_buffer *read_buffer, *write_buffer;
 		u8 *read, *write;
@@ -373,39 +393,96 @@ static int backup_log_sector(struct bow_context *bc)
 	return BLK_STS_OK;
 }
 
-static int add_log_entry(struct bow_context *bc, sector_t source, sector_t dest,
-			 unsigned int size, u32 checksum)
+static int write_log_sector(struct bow_context *bc)
 {
 	struct dm_buffer *sector_buffer;
 	u8 *sector;
 
+	sector = dm_bufio_new(bc->bufio, 0, &sector_buffer);
+	if (IS_ERR(sector)) {
+		DMERR("Cannot write boot sector");
+		return BLK_STS_NOSPC;
+	}
+
+	memcpy(sector, bc->log_sector, bc->block_size);
+	dm_bufio_mark_buffer_dirty(sector_buffer);
+	dm_bufio_release(sector_buffer);
+	dm_bufio_write_dirty_buffers(bc->bufio);
+	return BLK_STS_OK;
+}
+
+static int add_log_entry(struct bow_context *bc, sector_t source, sector_t dest,
+			 unsigned int size, u32 checksum)
+{
+	int ret;
+
 	if (sizeof(struct log_sector)
 	    + sizeof(struct log_entry) * (bc->log_sector->count + 1)
 		> bc->block_size) {
-		int ret = backup_log_sector(bc);
-
+		ret = backup_log_sector(bc);
 		if (ret)
 			return ret;
 	}
 
-	sector = dm_bufio_new(bc->bufio, 0, &sector_buffer);
-	if (IS_ERR(sector)) {
-		DMERR("Cannot write boot sector");
-		dm_bufio_release(sector_buffer);
-		return BLK_STS_NOSPC;
-	}
-
 	bc->log_sector->entries[bc->log_sector->count].source = source;
 	bc->log_sector->entries[bc->log_sector->count].dest = dest;
 	bc->log_sector->entries[bc->log_sector->count].size = size;
 	bc->log_sector->entries[bc->log_sector->count].checksum = checksum;
 	bc->log_sector->count++;
 
-	memcpy(sector, bc->log_sector, bc->block_size);
-	dm_bufio_mark_buffer_dirty(sector_buffer);
-	dm_bufio_release(sector_buffer);
-	dm_bufio_write_dirty_buffers(bc->bufio);
-	return BLK_STS_OK;
+	ret = write_log_sector(bc);
+	if (ret)
+		bc->log_sector->count--;
+	return ret;
+}
+
+/*
+ * Returns the last log entry if a backup of source to dest carries straight
+ * on from it, so the two can be recorded as one entry. Entries for sector 0
+ * are never extended since they hold the log itself.
+ */
+static struct log_entry *find_adjacent_log_entry(struct bow_context *bc,
+						 sector_t source,
+						 sector_t dest,
+						 unsigned int size)
+{
+	struct log_entry *le;
+
+	if (!bc->log_sector->count)
+		return NULL;
+
+	le = &bc->log_sector->entries[bc->log_sector->count - 1];
+	if (le->source == 0 || le->size > U32_MAX - size)
+		return NULL;
+
+	if (le->source + le->size / SECTOR_SIZE != source ||
+	    le->dest + le->size / SECTOR_SIZE != dest)
+		return NULL;
+
+	return le;
+}
+
+/*
+ * Grows le to also cover size more bytes. checksum is the checksum of the new
+ * bytes as calculated by copy_data, which is seeded with the page number of
+ * the first block. crc32 is linear in its seed, so replacing that seed with
+ * the running checksum of le gives the checksum of the combined range.
+ */
+static int extend_log_entry(struct bow_context *bc, struct log_entry *le,
+			    sector_t source, unsigned int size, u32 checksum)
+{
+	struct log_entry old = *le;
+	int ret;
+
+	le->checksum = checksum ^ crc32_le_shift(le->checksum ^
+						 sector_to_page(bc, source),
+						 size);
+	le->size += size;
+
+	ret = write_log_sector(bc);
+	if (ret)
+		*le = old;
+	return ret;
 }
 
 static int prepare_log(struct bow_context *bc)
@@ -543,6 +620,7 @@ static ssize_t state_store(struct kobject *kobj, struct kobj_attribute *attr,
 			DMERR("Failed to switch to checkpoint state");
 			goto bad;
 		}
+		bc->checkpoint_start = jiffies;
 	} else if (state == COMMITTED) {
 		struct bow_range *br = find_sector0_current(bc);
 		struct bow_range *sector0_br =
@@ -577,12 +655,50 @@ static ssize_t free_show(struct kobject *kobj, struct kobj_attribute *attr,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", trims_total);
 }
 
+static ssize_t backup_bytes_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	struct bow_context *bc = container_of(kobj, struct bow_context,
+					      kobj_holder.kobj);
+	u64 backup_bytes;
+
+	mutex_lock(&bc->ranges_lock);
+	backup_bytes = bc->backup_bytes;
+	mutex_unlock(&bc->ranges_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", backup_bytes);
+}
+
+/* Average bytes backed up per second since the checkpoint was started */
+static ssize_t backup_rate_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	struct bow_context *bc = container_of(kobj, struct bow_context,
+					      kobj_holder.kobj);
+	u64 backup_bytes = 0;
+	unsigned long elapsed = 0;
+
+	mutex_lock(&bc->ranges_lock);
+	if (atomic_read(&bc->state) != TRIM) {
+		backup_bytes = bc->backup_bytes;
+		elapsed = jiffies - bc->checkpoint_start;
+	}
+	mutex_unlock(&bc->ranges_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%llu\n",
+			 div64_u64(backup_bytes * HZ, max(elapsed, 1UL)));
+}
+
 static struct kobj_attribute attr_state = __ATTR_RW(state);
 static struct kobj_attribute attr_free = __ATTR_RO(free);
+static struct kobj_attribute attr_backup_bytes = __ATTR_RO(backup_bytes);
+static struct kobj_attribute attr_backup_rate = __ATTR_RO(backup_rate);
 
 static struct attribute *bow_attrs[] = {
 	&attr_state.attr,
 	&attr_free.attr,
+	&attr_backup_bytes.attr,
+	&attr_backup_rate.attr,
 	NULL
 };
 
@@ -745,6 +861,9 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 
 	mutex_init(&bc->ranges_lock);
 	bc->ranges = RB_ROOT;
+	spin_lock_init(&bc->pending_lock);
+	bio_list_init(&bc->pending_writes);
+	INIT_WORK(&bc->write_work, bow_write);
 	bc->bufio = dm_bufio_client_create(bc->dev->bdev, bc->block_size, 1, 0,
 					   NULL, NULL);
 	if (IS_ERR(bc->bufio)) {
@@ -807,6 +926,7 @@ static int prepare_unchanged_range(struct bow_context *bc, struct bow_range *br,
 {
 	struct bow_range *backup_br;
 	struct bvec_iter backup_bi;
+	struct log_entry *log_entry;
 	sector_t log_source, log_dest;
 	unsigned int log_size;
 	u32 checksum = 0;
@@ -867,14 +987,26 @@ static int prepare_unchanged_range(struct bow_context *bc, struct bow_range *br,
 
 	/*
 	 * Add the log entry after marking the backup sector, since adding a log
-	 * can cause another backup
+	 * can cause another backup. A backup that directly follows the previous
+	 * one on both source and destination just extends its entry.
 	 */
-	ret = add_log_entry(bc, log_source, log_dest, log_size, checksum);
+	log_entry = record_checksum ? find_adjacent_log_entry(bc, log_source,
+							      log_dest,
+							      log_size)
+				    : NULL;
+	if (log_entry)
+		ret = extend_log_entry(bc, log_entry, log_source, log_size,
+				       checksum);
+	else
+		ret = add_log_entry(bc, log_source, log_dest, log_size,
+				    checksum);
 	if (ret) {
 		br->type = original_type;
 		return ret;
 	}
 
+	bc->backup_bytes += log_size;
+
 	/* Now it is safe to mark this backup successful */
 	if (original_type == SECTOR0_CURRENT)
 		bc->log_sector->sector0 = sector0;
@@ -933,56 +1065,82 @@ static int prepare_one_range(struct bow_context *bc,
 	}
 }
 
-struct write_work {
-	struct work_struct work;
-	struct bow_context *bc;
-	struct bio *bio;
-};
-
-static void bow_write(struct work_struct *work)
+static int prepare_ranges(struct bow_context *bc, struct bvec_iter *run)
 {
-	struct write_work *ww = container_of(work, struct write_work, work);
-	struct bow_context *bc = ww->bc;
-	struct bio *bio = ww->bio;
-	struct bvec_iter bi_iter = bio->bi_iter;
-	int ret = BLK_STS_OK;
-
-	kfree(ww);
+	struct bvec_iter bi_iter = *run;
+	int ret;
 
-	mutex_lock(&bc->ranges_lock);
 	do {
 		ret = prepare_one_range(bc, &bi_iter);
 		bi_iter.bi_sector += bi_iter.bi_size / SECTOR_SIZE;
-		bi_iter.bi_size = bio->bi_iter.bi_size
-			- (bi_iter.bi_sector - bio->bi_iter.bi_sector)
-			  * SECTOR_SIZE;
+		bi_iter.bi_size = run->bi_size
+			- (bi_iter.bi_sector - run->bi_sector) * SECTOR_SIZE;
 	} while (!ret && bi_iter.bi_size);
 
-	mutex_unlock(&bc->ranges_lock);
+	return ret;
+}
 
-	if (!ret) {
-		bio_set_dev(bio, bc->dev->bdev);
-		submit_bio(bio);
-	} else {
-		DMERR("Write failure with error %d", -ret);
-		bio->bi_status = ret;
-		bio_endio(bio);
+/*
+ * Drains all queued writes. Writes that follow on from each other are
+ * prepared as a single run, so adjacent ranges are backed up together rather
+ * than one bio at a time.
+ */
+static void bow_write(struct work_struct *work)
+{
+	struct bow_context *bc = container_of(work, struct bow_context,
+					      write_work);
+	struct bio_list bios, run;
+	struct blk_plug plug;
+	struct bio *bio;
+
+	spin_lock(&bc->pending_lock);
+	bios = bc->pending_writes;
+	bio_list_init(&bc->pending_writes);
+	spin_unlock(&bc->pending_lock);
+
+	blk_start_plug(&plug);
+	while ((bio = bio_list_pop(&bios))) {
+		struct bvec_iter bi_iter = bio->bi_iter;
+		struct bio *next;
+		int ret;
+
+		bio_list_init(&run);
+		bio_list_add(&run, bio);
+		while ((next = bio_list_peek(&bios)) &&
+		       next->bi_iter.bi_sector == bvec_top(&bi_iter) &&
+		       bi_iter.bi_size + next->bi_iter.bi_size <=
+		       MAX_WRITE_RUN) {
+			bi_iter.bi_size += next->bi_iter.bi_size;
+			bio_list_add(&run, bio_list_pop(&bios));
+		}
+
+		mutex_lock(&bc->ranges_lock);
+		ret = prepare_ranges(bc, &bi_iter);
+		mutex_unlock(&bc->ranges_lock);
+
+		if (ret)
+			DMERR("Write failure with error %d", -ret);
+
+		while ((bio = bio_list_pop(&run))) {
+			if (!ret) {
+				bio_set_dev(bio, bc->dev->bdev);
+				submit_bio(bio);
+			} else {
+				bio->bi_status = ret;
+				bio_endio(bio);
+			}
+		}
 	}
+	blk_finish_plug(&plug);
 }
 
 static int queue_write(struct bow_context *bc, struct bio *bio)
 {
-	struct write_work *ww = kmalloc(sizeof(*ww), GFP_NOIO | __GFP_NORETRY
-					| __GFP_NOMEMALLOC | __GFP_NOWARN);
-	if (!ww) {
-		DMERR("Failed to allocate write_work");
-		return -ENOMEM;
-	}
+	spin_lock(&bc->pending_lock);
+	bio_list_add(&bc->pending_writes, bio);
+	spin_unlock(&bc->pending_lock);
 
-	INIT_WORK(&ww->work, bow_write);
-	ww->bc = bc;
-	ww->bio = bio;
-	queue_work(bc->workqueue, &ww->work);
+	queue_work(bc->workqueue, &bc->write_work);
 	return DM_MAPIO_SUBMITTED;
 }
 
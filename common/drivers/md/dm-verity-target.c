@@ -11,6 +11,15 @@
  * hash device. Setting this greatly improves performance when data and hash
  * are on the same disk on different partitions on devices with poor random
  * access behavior.
+ *
+ * The prefetch cluster is adapted per target to the observed access pattern:
+ * it grows while reads are sequential and decays on random access, with
+ * "prefetch_cluster" acting as the upper bound.
+ *
+ * In the file "/sys/module/dm_verity/parameters/pinned_hash_budget" you can
+ * set the amount of memory (in bytes) each target may use to keep the upper
+ * levels of the hash tree resident once they are verified. Whole levels are
+ * pinned starting from the root for as long as they fit into the budget.
  */
 
 #include "dm-verity.h"
@@ -25,6 +34,7 @@
 #define DM_VERITY_ENV_VAR_NAME		"DM_VERITY_ERR_BLOCK_NR"
 
 #define DM_VERITY_DEFAULT_PREFETCH_SIZE	262144
+#define DM_VERITY_DEFAULT_PINNED_BUDGET	1048576
 
 #define DM_VERITY_MAX_CORRUPTED_ERRS	100
 
@@ -41,11 +51,16 @@ static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
 
+static unsigned dm_verity_pinned_hash_budget = DM_VERITY_DEFAULT_PINNED_BUDGET;
+
+module_param_named(pinned_hash_budget, dm_verity_pinned_hash_budget, uint, S_IRUGO | S_IWUSR);
+
 struct dm_verity_prefetch_work {
 	struct work_struct work;
 	struct dm_verity *v;
 	sector_t block;
 	unsigned n_blocks;
+	unsigned cluster;
 };
 
 /*
@@ -261,6 +276,33 @@ out:
 	return 1;
 }
 
+/*
+ * Return true if the hash block lies in the pinned part of the tree and its
+ * verified contents are already resident.
+ */
+static bool verity_hash_block_pinned(struct dm_verity *v, sector_t hash_block)
+{
+	sector_t idx = hash_block - v->hash_start;
+
+	return idx < v->pinned_blocks && test_bit(idx, v->pinned_valid);
+}
+
+/*
+ * Copy a verified hash block into the pinned area. Concurrent callers copy
+ * identical data, so no locking is needed; the barrier orders the copy
+ * against the publication of the valid bit.
+ */
+static void verity_pin_hash_block(struct dm_verity *v, sector_t hash_block,
+				  const u8 *data)
+{
+	sector_t idx = hash_block - v->hash_start;
+
+	memcpy(v->pinned_data + (idx << v->hash_dev_block_bits), data,
+	       1 << v->hash_dev_block_bits);
+	smp_wmb();
+	set_bit(idx, v->pinned_valid);
+}
+
 /*
  * Verify hash of a metadata block pertaining to the specified data block
  * ("block" argument) at a specified level ("level" argument).
@@ -285,6 +327,15 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 
 	verity_hash_at_level(v, block, level, &hash_block, &offset);
 
+	if (level >= v->pinned_level &&
+	    verity_hash_block_pinned(v, hash_block)) {
+		smp_rmb();
+		data = v->pinned_data +
+			((hash_block - v->hash_start) << v->hash_dev_block_bits);
+		memcpy(want_digest, data + offset, v->digest_size);
+		return 0;
+	}
+
 	data = dm_bufio_read(v->bufio, hash_block, &buf);
 	if (IS_ERR(data))
 		return PTR_ERR(data);
@@ -318,6 +369,9 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 		}
 	}
 
+	if (level >= v->pinned_level && aux->hash_verified)
+		verity_pin_hash_block(v, hash_block, data);
+
 	data += offset;
 	memcpy(want_digest, data, v->digest_size);
 	r = 0;
@@ -611,8 +665,12 @@ static void verity_prefetch_io(struct work_struct *work)
 		sector_t hash_block_end;
 		verity_hash_at_level(v, pw->block, i, &hash_block_start, NULL);
 		verity_hash_at_level(v, pw->block + pw->n_blocks - 1, i, &hash_block_end, NULL);
+		if (i >= v->pinned_level &&
+		    verity_hash_block_pinned(v, hash_block_start) &&
+		    verity_hash_block_pinned(v, hash_block_end))
+			continue;
 		if (!i) {
-			unsigned cluster = READ_ONCE(dm_verity_prefetch_cluster);
+			unsigned cluster = pw->cluster;
 
 			cluster >>= v->data_dev_block_bits;
 			if (unlikely(!cluster))
@@ -634,10 +692,39 @@ no_prefetch_cluster:
 	kfree(pw);
 }
 
+/*
+ * Adapt the prefetch cluster to the access pattern: double it for every io
+ * that continues where the previous one ended, up to the "prefetch_cluster"
+ * limit, and decay it on random access so that scattered reads only fetch
+ * the hash blocks they need.
+ *
+ * The state is shared by all CPUs submitting to the target and updated
+ * without locking; a lost update only makes the heuristic less precise.
+ */
+static unsigned verity_adapt_prefetch(struct dm_verity *v,
+				      struct dm_verity_io *io)
+{
+	unsigned max_cluster = READ_ONCE(dm_verity_prefetch_cluster);
+	unsigned cluster = READ_ONCE(v->prefetch_cluster);
+
+	if (io->block == READ_ONCE(v->prefetch_next))
+		cluster = max(cluster << 1, 2U << v->data_dev_block_bits);
+	else
+		cluster >>= 2;
+
+	cluster = min(cluster, max_cluster);
+
+	WRITE_ONCE(v->prefetch_next, io->block + io->n_blocks);
+	WRITE_ONCE(v->prefetch_cluster, cluster);
+
+	return cluster;
+}
+
 static void verity_submit_prefetch(struct dm_verity *v, struct dm_verity_io *io)
 {
 	sector_t block = io->block;
 	unsigned int n_blocks = io->n_blocks;
+	unsigned cluster = verity_adapt_prefetch(v, io);
 	struct dm_verity_prefetch_work *pw;
 
 	if (v->validated_blocks) {
@@ -662,6 +749,7 @@ static void verity_submit_prefetch(struct dm_verity *v, struct dm_verity_io *io)
 	pw->v = v;
 	pw->block = block;
 	pw->n_blocks = n_blocks;
+	pw->cluster = cluster;
 	queue_work(v->verify_wq, &pw->work);
 }
 
@@ -829,6 +917,8 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->bufio)
 		dm_bufio_client_destroy(v->bufio);
 
+	kvfree(v->pinned_valid);
+	kvfree(v->pinned_data);
 	kvfree(v->validated_blocks);
 	kfree(v->salt);
 	kfree(v->root_digest);
@@ -873,6 +963,52 @@ static int verity_alloc_most_once(struct dm_verity *v)
 	return 0;
 }
 
+/*
+ * Reserve memory for the upper tree levels that fit into the pinned hash
+ * budget. Levels are laid out from the root down starting at hash_start, so
+ * the pinned levels form one contiguous range of hash blocks. Failure to
+ * allocate is not fatal, the tree is then read through dm-bufio only.
+ */
+static void verity_alloc_pinned_levels(struct dm_verity *v)
+{
+	unsigned long budget = READ_ONCE(dm_verity_pinned_hash_budget);
+	sector_t n_blocks = 0;
+	int i;
+
+	v->pinned_level = v->levels;
+
+	for (i = v->levels - 1; i >= 0; i--) {
+		sector_t end = i ? v->hash_level_block[i - 1] : v->hash_blocks;
+
+		if (end - v->hash_start > budget >> v->hash_dev_block_bits)
+			break;
+
+		n_blocks = end - v->hash_start;
+		v->pinned_level = i;
+	}
+
+	if (!n_blocks)
+		return;
+
+	v->pinned_data = kvmalloc(n_blocks << v->hash_dev_block_bits,
+				  GFP_KERNEL);
+	v->pinned_valid = kvcalloc(BITS_TO_LONGS(n_blocks),
+				   sizeof(unsigned long), GFP_KERNEL);
+	if (!v->pinned_data || !v->pinned_valid) {
+		kvfree(v->pinned_data);
+		kvfree(v->pinned_valid);
+		v->pinned_data = NULL;
+		v->pinned_valid = NULL;
+		v->pinned_level = v->levels;
+		return;
+	}
+
+	v->pinned_blocks = n_blocks;
+
+	/* Start reading the pinned levels so the first ios find them cached */
+	dm_bufio_prefetch(v->bufio, v->hash_start, n_blocks);
+}
+
 static int verity_alloc_zero_digest(struct dm_verity *v)
 {
 	int r = -ENOMEM;
@@ -1221,6 +1357,8 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		goto bad;
 	}
 
+	verity_alloc_pinned_levels(v);
+
 	/*
 	 * Using WQ_HIGHPRI improves throughput and completion latency by
 	 * reducing wait times when reading from a dm-verity device.
@@ -65,6 +65,20 @@ struct dm_verity {
 	struct dm_verity_fec *fec;	/* forward error correction */
 	unsigned long *validated_blocks; /* bitset blocks validated */
 
+	/*
+	 * Upper tree levels kept in memory once verified, so they never
+	 * compete with data for dm-bufio cache space. The pinned levels are
+	 * pinned_level..levels-1, stored contiguously from hash_start.
+	 */
+	u8 *pinned_data;
+	unsigned long *pinned_valid;	/* bitset of pinned blocks filled */
+	sector_t pinned_blocks;		/* number of pinned hash blocks */
+	unsigned char pinned_level;	/* lowest pinned level */
+
+	/* adaptive hash prefetch state, updated without locking */
+	sector_t prefetch_next;		/* block following the last io */
+	unsigned prefetch_cluster;	/* current prefetch cluster in bytes */
+
 	char *signature_key_desc; /* signature keyring reference */
 };
 
@@ -1133,10 +1133,12 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
  *        concurrent access will corrupt the list.
  *
  * Returns %false if element has been already added to the list, %true
- * otherwise.
+ * otherwise.  On success @first is set if the element was added to an
+ * empty list, i.e. the caller is the one who made the list non-empty.
  */
 static inline bool list_add_tail_lockless(struct list_head *new,
-					  struct list_head *head)
+					  struct list_head *head,
+					  bool *first)
 {
 	struct list_head *prev;
 
@@ -1166,6 +1168,7 @@ static inline bool list_add_tail_lockless(struct list_head *new,
 
 	prev->next = new;
 	new->prev = prev;
+	*first = prev == head;
 
 	return true;
 }
@@ -1211,10 +1214,17 @@ static inline bool chain_epi_lockless(struct epitem *epi)
  * single wait queue is serialized by wq.lock, but the case when multiple wait
  * queues are used should be detected accordingly.  This is detected using
  * cmpxchg() operation.
+ *
+ * Wakeups of ep->wq are coalesced: only the callback which makes ->rdllist
+ * non-empty wakes up a waiter.  Every waiter harvests the whole ready list,
+ * and ep_scan_ready_list() wakes up the next one if something is left over
+ * or was chained to ->ovflist meanwhile, so a burst of events from softirq
+ * context costs a single wakeup instead of one wq.lock round trip per event.
  */
 static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key)
 {
 	int pwake = 0;
+	bool first = false;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 	__poll_t pollflags = key_to_poll(key);
@@ -1254,15 +1264,17 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 			ep_pm_stay_awake_rcu(epi);
 	} else if (!ep_is_linked(epi)) {
 		/* In the usual case, add event to ready list. */
-		if (list_add_tail_lockless(&epi->rdllink, &ep->rdllist))
+		if (list_add_tail_lockless(&epi->rdllink, &ep->rdllist, &first))
 			ep_pm_stay_awake_rcu(epi);
 	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list.  If the ready list was not empty, or a transfer to user
+	 * space is in progress, a waiter has already been kicked and will pick
+	 * this event up as well.
 	 */
-	if (waitqueue_active(&ep->wq)) {
+	if (first && waitqueue_active(&ep->wq)) {
 		if ((epi->event.events & EPOLLEXCLUSIVE) &&
 					!(pollflags & POLLFREE)) {
 			switch (pollflags & EPOLLINOUT_BITS) {
@@ -1833,6 +1845,17 @@ static int ep_autoremove_wake_function(struct wait_queue_entry *wq_entry,
 	return ret;
 }
 
+/*
+ * Hands a coalesced wakeup over to the next waiter, see ep_poll_callback().
+ */
+static void ep_pass_wakeup(struct eventpoll *ep)
+{
+	write_lock_irq(&ep->lock);
+	if (ep_events_available(ep) && waitqueue_active(&ep->wq))
+		wake_up(&ep->wq);
+	write_unlock_irq(&ep->lock);
+}
+
 /**
  * ep_poll - Retrieves ready events, and delivers them to the caller supplied
  *           event buffer.
@@ -1991,6 +2014,14 @@ send_events:
 	    !(res = ep_send_events(ep, events, maxevents)) && !timed_out)
 		goto fetch_events;
 
+	/*
+	 * Wakeups are coalesced in ep_poll_callback(), so if we consumed one
+	 * but are bailing out without harvesting, hand it over to the next
+	 * waiter, otherwise it may sleep on a non-empty ready list.
+	 */
+	if (res < 0 && eavail)
+		ep_pass_wakeup(ep);
+
 	return res;
 }
 
@@ -1101,6 +1101,8 @@ struct ext4_inode_info {
 	/* extents status tree */
 	struct ext4_es_tree i_es_tree;
 	rwlock_t i_es_lock;
+	seqcount_rwlock_t i_es_seq;	/* i_es_tree changes, for lockless
+					   lookups */
 	struct list_head i_es_list;
 	unsigned int i_es_all_nr;	/* protected by i_es_lock */
 	unsigned int i_es_shk_nr;	/* protected by i_es_lock */
@@ -1426,6 +1428,9 @@ struct ext4_super_block {
 
 #define EXT4_ENC_UTF8_12_1	1
 
+/* Buckets of the mb_stats groups-scanned histogram: 0, 1, 2-3, ..., 64+ */
+#define EXT4_MB_SCAN_HIST_BUCKETS 8
+
 /*
  * fourth extended-fs super-block data in memory
  */
@@ -1526,9 +1531,17 @@ struct ext4_sb_info {
 	unsigned int s_mb_group_prealloc;
 	unsigned int s_mb_max_inode_prealloc;
 	unsigned int s_max_dir_size_kb;
-	/* where last allocation was done - for stream allocation */
-	unsigned long s_mb_last_group;
-	unsigned long s_mb_last_start;
+	unsigned int s_mb_optimize_scan;
+	unsigned int s_mb_max_linear_groups;
+	/*
+	 * where last allocation was done - for stream allocation; one
+	 * (group << 32 | start) goal per slot, slot chosen by inode number
+	 */
+	atomic64_t *s_mb_last_goals;
+	unsigned int s_mb_nr_goals;
+	/* groups indexed by largest free order / average fragment order */
+	struct xarray *s_mb_largest_free_orders;
+	struct xarray *s_mb_avg_fragment_orders;
 	unsigned int s_mb_prefetch;
 	unsigned int s_mb_prefetch_limit;
 
@@ -1544,6 +1557,8 @@ struct ext4_sb_info {
 	atomic64_t s_bal_cX_groups_considered[4];
 	atomic64_t s_bal_cX_hits[4];
 	atomic64_t s_bal_cX_failed[4];		/* cX loop didn't find blocks */
+	atomic64_t s_bal_scan_hist[EXT4_MB_SCAN_HIST_BUCKETS];
+						/* groups scanned per alloc */
 	atomic_t s_mb_buddies_generated;	/* number of buddies generated */
 	atomic64_t s_mb_generation_time;
 	atomic_t s_mb_lost_chunks;
@@ -1621,7 +1636,11 @@ struct ext4_sb_info {
 	spinlock_t s_bdev_wb_lock;
 
 	/* Ext4 fast commit stuff */
-	atomic_t s_fc_subtid;
+	atomic_t s_fc_subtid;		/* s_fc_start_seq of the last completed
+					 * fast commit */
+	unsigned int s_fc_start_seq;	/* fast commits started */
+	atomic_t s_fc_fsyncers;		/* tasks waiting for a fast commit */
+	pid_t s_fc_last_sync_writer;
 	atomic_t s_fc_ineligible_updates;
 	/*
 	 * After commit starts, the main queue gets locked, and the further
@@ -1637,7 +1656,8 @@ struct ext4_sb_info {
 	/*
 	 * Main fast commit lock. This lock protects accesses to the
 	 * following fields:
-	 * ei->i_fc_list, s_fc_dentry_q, s_fc_q, s_fc_bytes, s_fc_bh.
+	 * ei->i_fc_list, s_fc_dentry_q, s_fc_q, s_fc_bytes, s_fc_bh,
+	 * s_fc_start_seq, s_fc_stats.
 	 */
 	spinlock_t s_fc_lock;
 	struct buffer_head *s_fc_bh;
@@ -2819,6 +2839,7 @@ void __ext4_fc_track_create(handle_t *handle, struct inode *inode,
 void ext4_fc_track_create(handle_t *handle, struct dentry *dentry);
 void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
 void ext4_fc_mark_ineligible(struct super_block *sb, int reason);
+bool ext4_fc_logs_inode_body(struct super_block *sb);
 void ext4_fc_start_ineligible(struct super_block *sb, int reason);
 void ext4_fc_stop_ineligible(struct super_block *sb);
 void ext4_fc_start_update(struct inode *inode);
@@ -3331,6 +3352,8 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_order;/* order of bb_free/bb_fragments */
+	ext4_group_t	bb_group;	/* group number, for the order indexes */
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
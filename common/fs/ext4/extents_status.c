@@ -113,7 +113,9 @@
  *	next extent, adding a extent(a range of blocks) and removing a extent.
  *
  *   --	race on a extent status tree
- *	Extent status tree is protected by inode->i_es_lock.
+ *	Extent status tree is protected by inode->i_es_lock.  Writers also
+ *	bump inode->i_es_seq, which lets ext4_es_lookup_extent() find
+ *	cached extents under RCU without touching the lock.
  *
  *   --	memory consumption
  *      Fragmented extent tree will make extent status tree cost too much
@@ -156,11 +158,41 @@ static int __revise_pending(struct inode *inode, ext4_lblk_t lblk,
 			    ext4_lblk_t len,
 			    struct pending_reservation **prealloc);
 
+/*
+ * Every change to the extent status tree, and to the extents in it, happens
+ * between these so that lockless lookups can detect it.
+ */
+static inline void ext4_es_write_lock(struct ext4_inode_info *ei)
+{
+	write_lock(&ei->i_es_lock);
+	write_seqcount_begin(&ei->i_es_seq);
+}
+
+static inline bool ext4_es_write_trylock(struct ext4_inode_info *ei)
+{
+	if (!write_trylock(&ei->i_es_lock))
+		return false;
+	write_seqcount_begin(&ei->i_es_seq);
+	return true;
+}
+
+static inline void ext4_es_write_unlock(struct ext4_inode_info *ei)
+{
+	write_seqcount_end(&ei->i_es_seq);
+	write_unlock(&ei->i_es_lock);
+}
+
 int __init ext4_init_es(void)
 {
+	/*
+	 * Extents are type stable under RCU: a lockless lookup may read an
+	 * extent that is being freed and reused, and relies on i_es_seq to
+	 * throw away what it read.
+	 */
 	ext4_es_cachep = kmem_cache_create("ext4_extent_status",
 					   sizeof(struct extent_status),
-					   0, (SLAB_RECLAIM_ACCOUNT), NULL);
+					   0, (SLAB_RECLAIM_ACCOUNT |
+					       SLAB_TYPESAFE_BY_RCU), NULL);
 	if (ext4_es_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -837,7 +869,7 @@ static int __es_insert_extent(struct inode *inode, struct extent_status *newes,
 	ext4_es_init_extent(inode, es, newes->es_lblk, newes->es_len,
 			    newes->es_pblk);
 
-	rb_link_node(&es->rb_node, parent, p);
+	rb_link_node_rcu(&es->rb_node, parent, p);
 	rb_insert_color(&es->rb_node, &tree->root);
 
 out:
@@ -899,7 +931,7 @@ retry:
 		es2 = __es_alloc_extent(true);
 	if ((err1 || err2 || err3) && revise_pending && !pr)
 		pr = __alloc_pending(true);
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	err1 = __es_remove_extent(inode, lblk, end, NULL, es1);
 	if (err1 != 0)
@@ -933,7 +965,7 @@ retry:
 		}
 	}
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	if (err1 || err2 || err3)
 		goto retry;
 
@@ -967,12 +999,73 @@ void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	BUG_ON(end < lblk);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
 	if (!es || es->es_lblk > end)
 		__es_insert_extent(inode, &newes, NULL);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
+}
+
+/*
+ * Longest path a lockless lookup follows before giving up: the height of an
+ * rbtree with 2^32 nodes is bounded by 64.
+ */
+#define EXT4_ES_RCU_MAX_DEPTH	64
+
+/*
+ * Lockless lookup for the common case of a cached extent that is already
+ * marked referenced. Nothing shared is written, so threads mapping blocks
+ * of one inode in parallel don't bounce i_es_lock. Anything read while the
+ * tree changed is discarded thanks to i_es_seq, and the caller falls back
+ * to the locked lookup.
+ */
+static bool ext4_es_lookup_extent_rcu(struct ext4_inode_info *ei,
+				      ext4_lblk_t lblk,
+				      struct extent_status *es)
+{
+	struct extent_status *es1;
+	struct rb_node *node;
+	unsigned int seq;
+	int depth = 0;
+	bool found = false;
+
+	rcu_read_lock();
+	seq = raw_read_seqcount(&ei->i_es_seq);
+	if (seq & 1)
+		goto out;
+
+	es1 = READ_ONCE(ei->i_es_tree.cache_es);
+	if (!es1 || !in_range(lblk, READ_ONCE(es1->es_lblk),
+			      READ_ONCE(es1->es_len))) {
+		es1 = NULL;
+		node = READ_ONCE(ei->i_es_tree.root.rb_node);
+		while (node && depth++ < EXT4_ES_RCU_MAX_DEPTH) {
+			struct extent_status *e;
+
+			e = rb_entry(node, struct extent_status, rb_node);
+			if (lblk < READ_ONCE(e->es_lblk)) {
+				node = READ_ONCE(node->rb_left);
+			} else if (lblk > ext4_es_end(e)) {
+				node = READ_ONCE(node->rb_right);
+			} else {
+				es1 = e;
+				break;
+			}
+		}
+	}
+	if (!es1)
+		goto out;
+
+	es->es_lblk = READ_ONCE(es1->es_lblk);
+	es->es_len = READ_ONCE(es1->es_len);
+	es->es_pblk = READ_ONCE(es1->es_pblk);
+	/* Marking it referenced needs the lock */
+	found = ext4_es_is_referenced(es) &&
+		!read_seqcount_retry(&ei->i_es_seq, seq);
+out:
+	rcu_read_unlock();
+	return found;
 }
 
 /*
@@ -998,6 +1091,13 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	trace_ext4_es_lookup_extent_enter(inode, lblk);
 	es_debug("lookup extent in block %u\n", lblk);
 
+	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+	if (!next_lblk && ext4_es_lookup_extent_rcu(EXT4_I(inode), lblk, es)) {
+		percpu_counter_inc(&stats->es_stats_cache_hits);
+		trace_ext4_es_lookup_extent_exit(inode, es, 1);
+		return 1;
+	}
+
 	tree = &EXT4_I(inode)->i_es_tree;
 	read_lock(&EXT4_I(inode)->i_es_lock);
 
@@ -1025,7 +1125,6 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	}
 
 out:
-	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
 	if (found) {
 		BUG_ON(!es1);
 		es->es_lblk = es1->es_lblk;
@@ -1526,7 +1625,7 @@ retry:
 	 * so that we are sure __es_shrink() is done with the inode before it
 	 * is reclaimed.
 	 */
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end, &reserved, es);
 	/* Free preallocated extent if it didn't get used. */
 	if (es) {
@@ -1534,7 +1633,7 @@ retry:
 			__es_free_extent(es);
 		es = NULL;
 	}
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	if (err)
 		goto retry;
 
@@ -1580,7 +1679,7 @@ retry:
 			continue;
 		}
 
-		if (ei == locked_ei || !write_trylock(&ei->i_es_lock)) {
+		if (ei == locked_ei || !ext4_es_write_trylock(ei)) {
 			nr_skipped++;
 			continue;
 		}
@@ -1591,7 +1690,7 @@ retry:
 		spin_unlock(&sbi->s_es_lock);
 
 		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
-		write_unlock(&ei->i_es_lock);
+		ext4_es_write_unlock(ei);
 
 		if (nr_to_scan <= 0)
 			goto out;
@@ -1845,7 +1944,7 @@ void ext4_clear_inode_es(struct inode *inode)
 	struct ext4_es_tree *tree;
 	struct rb_node *node;
 
-	write_lock(&ei->i_es_lock);
+	ext4_es_write_lock(ei);
 	tree = &EXT4_I(inode)->i_es_tree;
 	tree->cache_es = NULL;
 	node = rb_first(&tree->root);
@@ -1858,7 +1957,7 @@ void ext4_clear_inode_es(struct inode *inode)
 		}
 	}
 	ext4_clear_inode_state(inode, EXT4_STATE_EXT_PRECACHED);
-	write_unlock(&ei->i_es_lock);
+	ext4_es_write_unlock(ei);
 }
 
 #ifdef ES_DEBUG__
@@ -2026,9 +2125,9 @@ void ext4_remove_pending(struct inode *inode, ext4_lblk_t lblk)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
 
-	write_lock(&ei->i_es_lock);
+	ext4_es_write_lock(ei);
 	__remove_pending(inode, lblk);
-	write_unlock(&ei->i_es_lock);
+	ext4_es_write_unlock(ei);
 }
 
 /*
@@ -2095,7 +2194,7 @@ retry:
 		es2 = __es_alloc_extent(true);
 	if ((err1 || err2 || err3) && allocated && !pr)
 		pr = __alloc_pending(true);
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	err1 = __es_remove_extent(inode, lblk, lblk, NULL, es1);
 	if (err1 != 0)
@@ -2127,7 +2226,7 @@ retry:
 		}
 	}
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	if (err1 || err2 || err3)
 		goto retry;
 
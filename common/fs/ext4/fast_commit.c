@@ -754,6 +754,18 @@ static  bool ext4_fc_add_dentry_tlv(struct super_block *sb, u16 tag,
 	return true;
 }
 
+/*
+ * Inode records carry the whole on-disk inode, in-inode xattr space
+ * included, unless that doesn't fit in a fast commit block. xattr updates
+ * which stay within the inode body then need no full commit.
+ */
+bool ext4_fc_logs_inode_body(struct super_block *sb)
+{
+	return EXT4_INODE_SIZE(sb) > EXT4_GOOD_OLD_INODE_SIZE &&
+		EXT4_INODE_SIZE(sb) + 2 * sizeof(struct ext4_fc_tl) +
+		sizeof(struct ext4_fc_inode) < sb->s_blocksize;
+}
+
 /*
  * Writes inode in the fast commit space under TLV with tag @tag.
  * Returns 0 on success, error on failure.
@@ -772,7 +784,9 @@ static int ext4_fc_write_inode(struct inode *inode, u32 *crc)
 	if (ret)
 		return ret;
 
-	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE)
+	if (ext4_fc_logs_inode_body(inode->i_sb))
+		inode_len = EXT4_INODE_SIZE(inode->i_sb);
+	else if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE)
 		inode_len += ei->i_extra_isize;
 
 	fc_inode.fc_ino = cpu_to_le32(inode->i_ino);
@@ -886,6 +900,7 @@ static int ext4_fc_submit_inode_data_all(journal_t *journal)
 
 	spin_lock(&sbi->s_fc_lock);
 	ext4_set_mount_flag(sb, EXT4_MF_FC_COMMITTING);
+	sbi->s_fc_start_seq++;
 	list_for_each(pos, &sbi->s_fc_q[FC_Q_MAIN]) {
 		ei = list_entry(pos, struct ext4_inode_info, i_fc_list);
 		ext4_set_inode_state(&ei->vfs_inode, EXT4_STATE_FC_COMMITTING);
@@ -1091,18 +1106,66 @@ out:
 	return ret;
 }
 
+/*
+ * Give fsyncs from other tasks that are in flight a chance to join the
+ * next fast commit, the same way jbd2_journal_stop() batches synchronous
+ * handles: if another task asked for the previous fast commit and others
+ * are waiting for one too, sleep for about one average fast commit,
+ * bounded by the journal's min/max batch time. A lone fsyncing task never
+ * waits.
+ */
+static void ext4_fc_batch_wait(journal_t *journal)
+{
+	struct super_block *sb = (struct super_block *)(journal->j_private);
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	pid_t pid = current->pid;
+	u64 commit_time;
+	ktime_t expires;
+
+	if (!journal->j_max_batch_time ||
+	    READ_ONCE(sbi->s_fc_last_sync_writer) == pid)
+		return;
+	WRITE_ONCE(sbi->s_fc_last_sync_writer, pid);
+	if (atomic_read(&sbi->s_fc_fsyncers) < 2)
+		return;
+
+	commit_time = max_t(u64, READ_ONCE(sbi->s_fc_avg_commit_time),
+			    1000ULL * journal->j_min_batch_time);
+	commit_time = min_t(u64, commit_time,
+			    1000ULL * journal->j_max_batch_time);
+	expires = ktime_add_ns(ktime_get(), commit_time);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+}
+
+static void ext4_fc_update_lat_hist(struct ext4_sb_info *sbi, int path,
+				    ktime_t start_time)
+{
+	u64 us = ktime_us_delta(ktime_get(), start_time);
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_stats.fc_lat_hist[path][min_t(int, fls64(us),
+						EXT4_FC_LAT_BUCKETS - 1)]++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
 /*
  * The main commit entry point. Performs a fast commit for transaction
  * commit_tid if needed. If it's not possible to perform a fast commit
  * due to various reasons, we fall back to full commit. Returns 0
  * on success, error otherwise.
+ *
+ * A fast commit writes out every inode queued when it starts, so
+ * concurrent callers are batched: a caller that finds a fast commit in
+ * progress only starts its own if no fast commit that started after its
+ * arrival has completed in the meantime.
  */
 int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 {
 	struct super_block *sb = (struct super_block *)(journal->j_private);
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int nblks = 0, ret, bsize = journal->j_blocksize;
-	int subtid = atomic_read(&sbi->s_fc_subtid);
+	unsigned int need_seq;
 	int reason = EXT4_FC_REASON_OK, fc_bufs_before = 0;
 	ktime_t start_time, commit_time;
 
@@ -1116,16 +1179,25 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 		goto out;
 	}
 
+	spin_lock(&sbi->s_fc_lock);
+	need_seq = sbi->s_fc_start_seq + 1;
+	spin_unlock(&sbi->s_fc_lock);
+
+	atomic_inc(&sbi->s_fc_fsyncers);
+	ext4_fc_batch_wait(journal);
 restart_fc:
 	ret = jbd2_fc_begin_commit(journal, commit_tid);
 	if (ret == -EALREADY) {
 		/* There was an ongoing commit, check if we need to restart */
-		if (atomic_read(&sbi->s_fc_subtid) <= subtid &&
+		if ((int)(atomic_read(&sbi->s_fc_subtid) - need_seq) < 0 &&
 			commit_tid > journal->j_commit_sequence)
 			goto restart_fc;
+		atomic_dec(&sbi->s_fc_fsyncers);
 		reason = EXT4_FC_REASON_ALREADY_COMMITTED;
 		goto out;
-	} else if (ret) {
+	}
+	atomic_dec(&sbi->s_fc_fsyncers);
+	if (ret) {
 		sbi->s_fc_stats.fc_ineligible_reason_count[EXT4_FC_COMMIT_FAILED]++;
 		reason = EXT4_FC_REASON_FC_START_FAILED;
 		goto out;
@@ -1145,7 +1217,8 @@ restart_fc:
 		reason = EXT4_FC_REASON_FC_FAILED;
 		goto out;
 	}
-	atomic_inc(&sbi->s_fc_subtid);
+	/* s_fc_start_seq is only changed by the committing task */
+	atomic_set(&sbi->s_fc_subtid, sbi->s_fc_start_seq);
 	jbd2_fc_end_commit(journal);
 out:
 	/* Has any ineligible update happened since we started? */
@@ -1177,13 +1250,18 @@ out:
 		sbi->s_fc_avg_commit_time = commit_time;
 	jbd_debug(1,
 		"Fast commit ended with blks = %d, reason = %d, subtid - %d",
-		nblks, reason, subtid);
+		nblks, reason, atomic_read(&sbi->s_fc_subtid));
 	if (reason == EXT4_FC_REASON_FC_FAILED)
-		return jbd2_fc_end_commit_fallback(journal);
-	if (reason == EXT4_FC_REASON_FC_START_FAILED ||
+		ret = jbd2_fc_end_commit_fallback(journal);
+	else if (reason == EXT4_FC_REASON_FC_START_FAILED ||
 		reason == EXT4_FC_REASON_INELIGIBLE)
-		return jbd2_complete_transaction(journal, commit_tid);
-	return 0;
+		ret = jbd2_complete_transaction(journal, commit_tid);
+	else
+		ret = 0;
+	ext4_fc_update_lat_hist(sbi, (reason == EXT4_FC_REASON_OK ||
+			reason == EXT4_FC_REASON_ALREADY_COMMITTED) ?
+			EXT4_FC_LAT_FAST : EXT4_FC_LAT_FULL, start_time);
+	return ret;
 }
 
 /*
@@ -2181,6 +2259,19 @@ int ext4_fc_info_show(struct seq_file *seq, void *v)
 	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
 		seq_printf(seq, "\"%s\":\t%d\n", fc_ineligible_reasons[i],
 			stats->fc_ineligible_reason_count[i]);
+	seq_puts(seq, "Commit latency (us):\tfast\tfull\n");
+	for (i = 0; i < EXT4_FC_LAT_BUCKETS; i++) {
+		if (i == 0)
+			seq_puts(seq, "0");
+		else if (i == EXT4_FC_LAT_BUCKETS - 1)
+			seq_printf(seq, "%llu+", 1ULL << (i - 1));
+		else
+			seq_printf(seq, "%llu-%llu", 1ULL << (i - 1),
+				   (1ULL << i) - 1);
+		seq_printf(seq, ":\t%lu\t%lu\n",
+			   stats->fc_lat_hist[EXT4_FC_LAT_FAST][i],
+			   stats->fc_lat_hist[EXT4_FC_LAT_FULL][i]);
+	}
 
 	return 0;
 }
@@ -108,11 +108,25 @@ enum {
 	EXT4_FC_REASON_MAX
 };
 
+/*
+ * Commit latency histogram: commits served by a fast commit versus those
+ * that needed a full jbd2 commit. Bucket i counts latencies in
+ * [2^(i-1), 2^i) microseconds.
+ */
+enum {
+	EXT4_FC_LAT_FAST = 0,
+	EXT4_FC_LAT_FULL,
+	EXT4_FC_LAT_MAX
+};
+
+#define EXT4_FC_LAT_BUCKETS	20
+
 struct ext4_fc_stats {
 	unsigned int fc_ineligible_reason_count[EXT4_FC_REASON_MAX];
 	unsigned long fc_num_commits;
 	unsigned long fc_ineligible_commits;
 	unsigned long fc_numblks;
+	unsigned long fc_lat_hist[EXT4_FC_LAT_MAX][EXT4_FC_LAT_BUCKETS];
 };
 
 #define EXT4_FC_REPLAY_REALLOC_INCREMENT	4
@@ -747,13 +747,33 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 	}
 }
 
+/*
+ * Move @grp from slot @old to slot @new of the per-order index @xa. The
+ * indexes are only hints for cr 0/1 group selection: a group missing from
+ * them because of an allocation failure is still found by the linear scan.
+ * Called with the group lock held.
+ */
+static void mb_reindex_group(struct xarray *xa, struct ext4_group_info *grp,
+			     int old, int new)
+{
+	if (old == new)
+		return;
+	if (old >= 0)
+		xa_erase(&xa[old], grp->bb_group);
+	if (new >= 0)
+		xa_store(&xa[new], grp->bb_group, grp, GFP_ATOMIC);
+}
+
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and the order of its average free extent size, and keep the group
+ * indexed under both.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
 	int i;
 	int bits;
 
@@ -766,6 +786,17 @@ mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 			break;
 		}
 	}
+	mb_reindex_group(sbi->s_mb_largest_free_orders, grp, old,
+			 grp->bb_largest_free_order);
+
+	old = grp->bb_avg_fragment_order;
+	if (grp->bb_free && grp->bb_fragments)
+		grp->bb_avg_fragment_order = min_t(int, bits,
+				fls(grp->bb_free / grp->bb_fragments) - 1);
+	else
+		grp->bb_avg_fragment_order = -1;
+	mb_reindex_group(sbi->s_mb_avg_fragment_orders, grp, old,
+			 grp->bb_avg_fragment_order);
 }
 
 static noinline_for_stack
@@ -1701,13 +1732,25 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 	return ret;
 }
 
+/*
+ * Stream allocations keep one goal per slot instead of one per filesystem,
+ * so that writers to different inodes neither serialize on s_md_lock nor
+ * all chase the same group. An inode always maps to the same slot, which
+ * keeps its extents close together.
+ */
+static atomic64_t *ext4_mb_stream_goal(struct ext4_allocation_context *ac)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+
+	return &sbi->s_mb_last_goals[ac->ac_inode->i_ino % sbi->s_mb_nr_goals];
+}
+
 /*
  * Must be called under group lock!
  */
 static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 					struct ext4_buddy *e4b)
 {
-	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
 	int ret;
 
 	BUG_ON(ac->ac_b_ex.fe_group != e4b->bd_group);
@@ -1737,12 +1780,10 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	ac->ac_buddy_page = e4b->bd_buddy_page;
 	get_page(ac->ac_buddy_page);
 	/* store last allocated for subsequent stream allocation */
-	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		spin_lock(&sbi->s_md_lock);
-		sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
-		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
-		spin_unlock(&sbi->s_md_lock);
-	}
+	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC)
+		atomic64_set(ext4_mb_stream_goal(ac),
+			     ((u64)ac->ac_f_ex.fe_group << 32) |
+			     (u32)ac->ac_f_ex.fe_start);
 	/*
 	 * As we've just preallocated more space than
 	 * user requested originally, we store allocated
@@ -2320,11 +2361,103 @@ void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
 	}
 }
 
+static inline ext4_group_t ext4_mb_next_linear_group(ext4_group_t group,
+						     ext4_group_t ngroups)
+{
+	return group + 1 >= ngroups ? 0 : group + 1;
+}
+
+/*
+ * Look for a group in [@start, @last] of the order index @xa that passes the
+ * lockless cr check. The index is only a hint, the caller rechecks the group.
+ */
+static bool ext4_mb_scan_order_index(struct ext4_allocation_context *ac,
+				     struct xarray *xa, ext4_group_t start,
+				     ext4_group_t last, ext4_group_t *group)
+{
+	struct ext4_group_info *grp;
+	unsigned long index;
+
+	xa_for_each_range(xa, index, grp, start, last) {
+		if (ext4_mb_good_group(ac, index, ac->ac_criteria)) {
+			*group = index;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * cr 0 wants a group whose largest free order is at least ac_2order, cr 1 a
+ * group whose average free extent is at least the goal length. Walk the
+ * matching order indexes from the smallest sufficient order up, starting
+ * after @*group and wrapping around, so that allocations still move forward
+ * from the goal instead of piling up on the lowest indexed group.
+ */
+static bool ext4_mb_find_indexed_group(struct ext4_allocation_context *ac,
+				       ext4_group_t *group, ext4_group_t ngroups)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	ext4_group_t start = ext4_mb_next_linear_group(*group, ngroups);
+	struct xarray *xa;
+	int order;
+
+	if (ac->ac_criteria == 0) {
+		xa = sbi->s_mb_largest_free_orders;
+		order = ac->ac_2order;
+	} else {
+		xa = sbi->s_mb_avg_fragment_orders;
+		order = fls(ac->ac_g_ex.fe_len) - 1;
+	}
+
+	for (; order < MB_NUM_ORDERS(ac->ac_sb); order++) {
+		if (ext4_mb_scan_order_index(ac, &xa[order], start,
+					     ngroups - 1, group))
+			return true;
+		if (start && ext4_mb_scan_order_index(ac, &xa[order], 0,
+						      start - 1, group))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Pick the group the allocator looks at next. cr 2/3, and the first
+ * s_mb_max_linear_groups groups after the goal, walk the groups linearly.
+ * Otherwise cr 0/1 go straight to a group from the order indexes, and when
+ * none qualifies the criteria is relaxed through @new_cr without visiting
+ * every group. Groups whose buddy was never loaded are not indexed yet;
+ * cr 2 still scans (and prefetches) those.
+ */
+static void ext4_mb_choose_next_group(struct ext4_allocation_context *ac,
+				      int *new_cr, ext4_group_t *group,
+				      ext4_group_t ngroups)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+
+	*new_cr = ac->ac_criteria;
+
+	if (!sbi->s_mb_optimize_scan || ac->ac_criteria >= 2 ||
+	    ac->ac_groups_linear_remaining) {
+		if (ac->ac_groups_linear_remaining)
+			ac->ac_groups_linear_remaining--;
+		*group = ext4_mb_next_linear_group(*group, ngroups);
+		return;
+	}
+
+	if (ext4_mb_find_indexed_group(ac, group, ngroups))
+		return;
+
+	if (sbi->s_mb_stats)
+		atomic64_inc(&sbi->s_bal_cX_failed[ac->ac_criteria]);
+	*new_cr = ac->ac_criteria + 1;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t prefetch_grp = 0, ngroups, group, i;
-	int cr = -1;
+	int cr = -1, new_cr;
 	int err = 0, first_err = 0;
 	unsigned int nr = 0, prefetch_ios = 0;
 	struct ext4_sb_info *sbi;
@@ -2372,17 +2505,18 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 							   sb->s_blocksize_bits + 2);
 	}
 
-	/* if stream allocation is enabled, use global goal */
+	/* if stream allocation is enabled, use the inode's stream goal */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		/* TBD: may be hot point */
-		spin_lock(&sbi->s_md_lock);
-		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
-		ac->ac_g_ex.fe_start = sbi->s_mb_last_start;
-		spin_unlock(&sbi->s_md_lock);
+		u64 goal = atomic64_read(ext4_mb_stream_goal(ac));
+
+		ac->ac_g_ex.fe_group = goal >> 32;
+		ac->ac_g_ex.fe_start = (u32)goal;
 	}
 
 	/* Let's just scan groups to find more-less suitable blocks */
 	cr = ac->ac_2order ? 0 : 1;
+	ac->ac_groups_linear_remaining = min_t(unsigned int, U16_MAX,
+					       sbi->s_mb_max_linear_groups);
 	/*
 	 * cr == 0 try to get exact allocation,
 	 * cr == 3  try to get anything
@@ -2397,9 +2531,15 @@ repeat:
 		group = ac->ac_g_ex.fe_group;
 		prefetch_grp = group;
 
-		for (i = 0; i < ngroups; group++, i++) {
+		for (i = 0, new_cr = cr; i < ngroups; i++,
+		     ext4_mb_choose_next_group(ac, &new_cr, &group, ngroups)) {
 			int ret = 0;
+
 			cond_resched();
+			if (new_cr != cr) {
+				cr = new_cr;
+				goto repeat;
+			}
 			/*
 			 * Artificially restricted ngroups for non-extent
 			 * files makes group > ngroups possible on first loop.
@@ -2613,6 +2753,7 @@ int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
 {
 	struct super_block *sb = (struct super_block *)seq->private;
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
 
 	seq_puts(seq, "mballoc:\n");
 	if (!sbi->s_mb_stats) {
@@ -2624,6 +2765,19 @@ int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
 	seq_printf(seq, "\tsuccess: %u\n", atomic_read(&sbi->s_bal_success));
 
 	seq_printf(seq, "\tgroups_scanned: %u\n",  atomic_read(&sbi->s_bal_groups_scanned));
+	seq_printf(seq, "\toptimize_scan: %u\n", sbi->s_mb_optimize_scan);
+	seq_puts(seq, "\tgroups_scanned_per_alloc:\n");
+	for (i = 0; i < EXT4_MB_SCAN_HIST_BUCKETS; i++) {
+		if (i < 2)
+			seq_printf(seq, "\t\t%d: ", i);
+		else if (i == EXT4_MB_SCAN_HIST_BUCKETS - 1)
+			seq_printf(seq, "\t\t%d+: ", 1 << (i - 1));
+		else
+			seq_printf(seq, "\t\t%d-%d: ", 1 << (i - 1),
+				   (1 << i) - 1);
+		seq_printf(seq, "%llu\n",
+			   atomic64_read(&sbi->s_bal_scan_hist[i]));
+	}
 
 	seq_puts(seq, "\tcr0_stats:\n");
 	seq_printf(seq, "\t\thits: %llu\n", atomic64_read(&sbi->s_bal_cX_hits[0]));
@@ -2773,6 +2927,8 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_order = -1;
+	meta_group_info[i]->bb_group = group;
 
 	mb_group_bb_bitmap_alloc(sb, meta_group_info[i], group);
 	return 0;
@@ -2983,6 +3139,8 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_max_inode_prealloc = MB_DEFAULT_MAX_INODE_PREALLOC;
+	sbi->s_mb_optimize_scan = 1;
+	sbi->s_mb_max_linear_groups = MB_DEFAULT_MAX_LINEAR_GROUPS;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -3024,14 +3182,50 @@ int ext4_mb_init(struct super_block *sb)
 		spin_lock_init(&lg->lg_prealloc_lock);
 	}
 
+	i = MB_NUM_ORDERS(sb);
+	sbi->s_mb_largest_free_orders = kmalloc_array(i, sizeof(struct xarray),
+						      GFP_KERNEL);
+	sbi->s_mb_avg_fragment_orders = kmalloc_array(i, sizeof(struct xarray),
+						      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders || !sbi->s_mb_avg_fragment_orders) {
+		ret = -ENOMEM;
+		goto out_free_orders;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		xa_init(&sbi->s_mb_largest_free_orders[i]);
+		xa_init(&sbi->s_mb_avg_fragment_orders[i]);
+	}
+
+	sbi->s_mb_nr_goals = num_possible_cpus();
+	sbi->s_mb_last_goals = kcalloc(sbi->s_mb_nr_goals,
+				       sizeof(*sbi->s_mb_last_goals),
+				       GFP_KERNEL);
+	if (!sbi->s_mb_last_goals) {
+		ret = -ENOMEM;
+		goto out_free_orders;
+	}
+
 	/* init file for buddy data */
 	ret = ext4_mb_init_backend(sb);
 	if (ret != 0)
-		goto out_free_locality_groups;
+		goto out_free_goals;
+
+	/* spread the stream goals over the filesystem */
+	for (i = 0; i < sbi->s_mb_nr_goals; i++)
+		atomic64_set(&sbi->s_mb_last_goals[i],
+			     div_u64((u64)ext4_get_groups_count(sb) * i,
+				     sbi->s_mb_nr_goals) << 32);
 
 	return 0;
 
-out_free_locality_groups:
+out_free_goals:
+	kfree(sbi->s_mb_last_goals);
+	sbi->s_mb_last_goals = NULL;
+out_free_orders:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_avg_fragment_orders);
+	sbi->s_mb_avg_fragment_orders = NULL;
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
@@ -3093,6 +3287,13 @@ int ext4_mb_release(struct super_block *sb)
 		kvfree(group_info);
 		rcu_read_unlock();
 	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		xa_destroy(&sbi->s_mb_largest_free_orders[i]);
+		xa_destroy(&sbi->s_mb_avg_fragment_orders[i]);
+	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_avg_fragment_orders);
+	kfree(sbi->s_mb_last_goals);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -3756,6 +3957,9 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 			atomic_inc(&sbi->s_bal_success);
 		atomic_add(ac->ac_found, &sbi->s_bal_ex_scanned);
 		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
+		atomic64_inc(&sbi->s_bal_scan_hist[min_t(int,
+				fls(ac->ac_groups_scanned),
+				EXT4_MB_SCAN_HIST_BUCKETS - 1)]);
 		if (ac->ac_g_ex.fe_start == ac->ac_b_ex.fe_start &&
 				ac->ac_g_ex.fe_group == ac->ac_b_ex.fe_group)
 			atomic_inc(&sbi->s_bal_goals);
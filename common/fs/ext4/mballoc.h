@@ -20,6 +20,7 @@
 #include <linux/seq_file.h>
 #include <linux/blkdev.h>
 #include <linux/mutex.h>
+#include <linux/xarray.h>
 #include "ext4_jbd2.h"
 #include "ext4.h"
 
@@ -78,6 +79,17 @@
  */
 #define MB_DEFAULT_MAX_INODE_PREALLOC	512
 
+/*
+ * Number of groups scanned linearly from the goal before cr 0/1 switch
+ * to the per-order group indexes, to preserve allocation locality
+ */
+#define MB_DEFAULT_MAX_LINEAR_GROUPS	4
+
+/*
+ * Number of buddy orders tracked per filesystem: 0 .. blocksize_bits + 1
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
 	struct list_head		efd_list;
@@ -162,6 +174,7 @@ struct ext4_allocation_context {
 	struct ext4_free_extent ac_f_ex;
 
 	__u16 ac_groups_scanned;
+	__u16 ac_groups_linear_remaining;
 	__u16 ac_found;
 	__u16 ac_tail;
 	__u16 ac_buddy;
@@ -4157,11 +4157,12 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (unlikely(retval))
 		goto end_rename;
 
-	if (S_ISDIR(old.inode->i_mode)) {
+	if (S_ISDIR(old.inode->i_mode) && old.dir != new.dir) {
 		/*
 		 * We disable fast commits here that's because the
 		 * replay code is not yet capable of changing dot dot
-		 * dirents in directories.
+		 * dirents in directories. A directory renamed within
+		 * its parent keeps its dot dot entry.
 		 */
 		ext4_fc_mark_ineligible(old.inode->i_sb,
 			EXT4_FC_REASON_RENAME_DIR);
@@ -4324,8 +4325,17 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	retval = ext4_mark_inode_dirty(handle, new.inode);
 	if (unlikely(retval))
 		goto end_rename;
-	ext4_fc_mark_ineligible(new.inode->i_sb,
-				EXT4_FC_REASON_CROSS_RENAME);
+	if (old.dir != new.dir && (old.is_dir || new.is_dir)) {
+		/* Replay can't change the dot dot entry of a directory */
+		ext4_fc_mark_ineligible(new.inode->i_sb,
+					EXT4_FC_REASON_CROSS_RENAME);
+	} else {
+		/* Unlinks first: replay can't add an entry that still exists */
+		__ext4_fc_track_unlink(handle, old.inode, old.dentry);
+		__ext4_fc_track_unlink(handle, new.inode, new.dentry);
+		__ext4_fc_track_link(handle, new.inode, old.dentry);
+		__ext4_fc_track_link(handle, old.inode, new.dentry);
+	}
 	if (old.dir_bh) {
 		retval = ext4_rename_dir_finish(handle, &old, new.dir->i_ino);
 		if (retval)
@@ -280,6 +280,8 @@ int ext4_mpage_readpages(struct inode *inode,
 	unsigned relative_block = 0;
 	struct ext4_map_blocks map;
 	unsigned int nr_pages = rac ? readahead_count(rac) : 1;
+	struct page *batch[PAGEVEC_SIZE];
+	unsigned int batch_nr = 0, batch_idx = 0;
 
 	map.m_pblk = 0;
 	map.m_lblk = 0;
@@ -291,8 +293,21 @@ int ext4_mpage_readpages(struct inode *inode,
 		unsigned first_hole = blocks_per_page;
 
 		if (rac) {
-			page = readahead_page(rac);
-			prefetchw(&page->flags);
+			/*
+			 * Take the readahead pages from the page cache a
+			 * batch at a time rather than with one lookup each.
+			 */
+			if (batch_idx == batch_nr) {
+				unsigned int i;
+
+				batch_nr = readahead_page_batch(rac, batch);
+				if (WARN_ON_ONCE(!batch_nr))
+					break;
+				for (i = 0; i < batch_nr; i++)
+					prefetchw(&batch[i]->flags);
+				batch_idx = 0;
+			}
+			page = batch[batch_idx++];
 		}
 
 		if (page_has_buffers(page))
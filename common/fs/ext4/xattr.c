@@ -1880,6 +1880,8 @@ ext4_xattr_block_set(handle_t *handle, struct inode *inode,
 	size_t old_ea_inode_quota = 0;
 	unsigned int ea_ino;
 
+	/* Fast commits only log the inode body, not xattr blocks */
+	ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_XATTR);
 
 #define header(x) ((struct ext4_xattr_header *)(x))
 
@@ -2432,7 +2434,14 @@ retry_inode:
 		if (IS_SYNC(inode))
 			ext4_handle_sync(handle);
 	}
-	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR);
+	/*
+	 * In-inode xattrs are covered by the fast commit inode record,
+	 * xattr blocks are marked in ext4_xattr_block_set(). EA inodes
+	 * always need a full commit.
+	 */
+	if (!ext4_fc_logs_inode_body(inode->i_sb) ||
+	    ext4_has_feature_ea_inode(inode->i_sb))
+		ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR);
 
 cleanup:
 	brelse(is.iloc.bh);
@@ -2510,7 +2519,6 @@ retry:
 		if (error == 0)
 			error = error2;
 	}
-	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_XATTR);
 
 	return error;
 }
@@ -97,7 +97,9 @@ static bool wb_io_lists_populated(struct bdi_writeback *wb)
 
 static void wb_io_lists_depopulated(struct bdi_writeback *wb)
 {
-	if (wb_has_dirty_io(wb) && list_empty(&wb->b_dirty) &&
+	/* inodes moved off b_io by wb_writeback_parallel() still count */
+	if (wb_has_dirty_io(wb) && !wb->nr_io_shards &&
+	    list_empty(&wb->b_dirty) &&
 	    list_empty(&wb->b_io) && list_empty(&wb->b_more_io)) {
 		clear_bit(WB_has_dirty_io, &wb->state);
 		WARN_ON_ONCE(atomic_long_sub_return(wb->avg_write_bandwidth,
@@ -1629,7 +1631,8 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
 }
 
 /*
- * Write a portion of b_io inodes which belong to @sb.
+ * Write a portion of @io inodes which belong to @sb.  @io is either
+ * wb->b_io or one shard of it, see wb_writeback_parallel().
  *
  * Return the number of pages and/or inodes written.
  *
@@ -1639,7 +1642,8 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
  */
 static long writeback_sb_inodes(struct super_block *sb,
 				struct bdi_writeback *wb,
-				struct wb_writeback_work *work)
+				struct wb_writeback_work *work,
+				struct list_head *io)
 {
 	struct writeback_control wbc = {
 		.sync_mode		= work->sync_mode,
@@ -1655,8 +1659,8 @@ static long writeback_sb_inodes(struct super_block *sb,
 	long write_chunk;
 	long total_wrote = 0;  /* count both pages and inodes */
 
-	while (!list_empty(&wb->b_io)) {
-		struct inode *inode = wb_inode(wb->b_io.prev);
+	while (!list_empty(io)) {
+		struct inode *inode = wb_inode(io->prev);
 		struct bdi_writeback *tmp_wb;
 		long wrote;
 
@@ -1783,13 +1787,14 @@ static long writeback_sb_inodes(struct super_block *sb,
 }
 
 static long __writeback_inodes_wb(struct bdi_writeback *wb,
-				  struct wb_writeback_work *work)
+				  struct wb_writeback_work *work,
+				  struct list_head *io)
 {
 	unsigned long start_time = jiffies;
 	long wrote = 0;
 
-	while (!list_empty(&wb->b_io)) {
-		struct inode *inode = wb_inode(wb->b_io.prev);
+	while (!list_empty(io)) {
+		struct inode *inode = wb_inode(io->prev);
 		struct super_block *sb = inode->i_sb;
 
 		if (!trylock_super(sb)) {
@@ -1801,7 +1806,7 @@ static long __writeback_inodes_wb(struct bdi_writeback *wb,
 			redirty_tail(inode, wb);
 			continue;
 		}
-		wrote += writeback_sb_inodes(sb, wb, work);
+		wrote += writeback_sb_inodes(sb, wb, work, io);
 		up_read(&sb->s_umount);
 
 		/* refer to the same tests at the end of writeback_sb_inodes */
@@ -1831,13 +1836,130 @@ static long writeback_inodes_wb(struct bdi_writeback *wb, long nr_pages,
 	spin_lock(&wb->list_lock);
 	if (list_empty(&wb->b_io))
 		queue_io(wb, &work, jiffies);
-	__writeback_inodes_wb(wb, &work);
+	__writeback_inodes_wb(wb, &work, &wb->b_io);
 	spin_unlock(&wb->list_lock);
 	blk_finish_plug(&plug);
 
 	return nr_pages - work.nr_pages;
 }
 
+static long wb_writeback_io(struct bdi_writeback *wb,
+			    struct wb_writeback_work *work,
+			    struct list_head *io)
+{
+	if (work->sb)
+		return writeback_sb_inodes(work->sb, wb, work, io);
+	return __writeback_inodes_wb(wb, work, io);
+}
+
+/*
+ * One shard of a parallel writeback round, see wb_writeback_parallel().
+ */
+struct wb_writeback_shard {
+	struct work_struct work;
+	struct bdi_writeback *wb;
+	struct wb_writeback_work wb_work;	/* private copy of the work */
+	struct list_head io;		/* inodes of this shard */
+	long progress;
+	struct completion done;
+};
+
+static void wb_writeback_shard_fn(struct work_struct *work)
+{
+	struct wb_writeback_shard *shard = container_of(work,
+				struct wb_writeback_shard, work);
+	struct bdi_writeback *wb = shard->wb;
+	struct blk_plug plug;
+
+	current->flags |= PF_SWAPWRITE;
+	blk_start_plug(&plug);
+	spin_lock(&wb->list_lock);
+	shard->progress = wb_writeback_io(wb, &shard->wb_work, &shard->io);
+	spin_unlock(&wb->list_lock);
+	blk_finish_plug(&plug);
+	current->flags &= ~PF_SWAPWRITE;
+
+	complete(&shard->done);
+}
+
+/*
+ * Write back b_io with @nr workers for devices which a single flusher
+ * can't keep busy.  b_io is split into per-worker shards by inode number,
+ * so an inode is only ever handled by one worker during a round and its
+ * writeback stays ordered the same way as with a single flusher.  The
+ * calling flusher handles the first shard itself and waits for the rest,
+ * so the wb, its cgroup association and the work stay pinned for the
+ * whole round.  Whatever a shard didn't get to goes back onto b_io.
+ * While the round runs, wb->nr_io_shards keeps wb_io_lists_depopulated()
+ * from clearing WB_has_dirty_io, as the shard lists aren't visible to it.
+ * The other shards run on bdi_shard_wq: waiting on items of bdi_wq from
+ * bdi_wq could deadlock once the flusher runs on its rescuer.
+ *
+ * Called with wb->list_lock held, like writeback_sb_inodes().
+ */
+static long wb_writeback_parallel(struct bdi_writeback *wb,
+				  struct wb_writeback_work *work,
+				  unsigned int nr)
+{
+	struct wb_writeback_shard *shards;
+	long share = max(work->nr_pages / nr, 1L);
+	long progress = 0;
+	unsigned int i;
+
+	shards = kcalloc(nr, sizeof(*shards), GFP_NOWAIT | __GFP_NOWARN);
+	if (!shards)
+		return wb_writeback_io(wb, work, &wb->b_io);
+
+	for (i = 0; i < nr; i++) {
+		struct wb_writeback_shard *shard = &shards[i];
+
+		INIT_WORK(&shard->work, wb_writeback_shard_fn);
+		shard->wb = wb;
+		shard->wb_work = *work;
+		shard->wb_work.nr_pages = share;
+		INIT_LIST_HEAD(&shard->io);
+		init_completion(&shard->done);
+	}
+
+	wb->nr_io_shards++;
+
+	/* writeback consumes from the tail, preserve that order per shard */
+	while (!list_empty(&wb->b_io)) {
+		struct inode *inode = wb_inode(wb->b_io.prev);
+
+		list_move(&inode->i_io_list, &shards[inode->i_ino % nr].io);
+	}
+
+	spin_unlock(&wb->list_lock);
+	for (i = 1; i < nr; i++) {
+		if (list_empty(&shards[i].io))
+			complete(&shards[i].done);
+		else
+			queue_work(bdi_shard_wq, &shards[i].work);
+	}
+	spin_lock(&wb->list_lock);
+	shards[0].progress = wb_writeback_io(wb, &shards[0].wb_work,
+					     &shards[0].io);
+	spin_unlock(&wb->list_lock);
+
+	for (i = 1; i < nr; i++)
+		wait_for_completion(&shards[i].done);
+
+	spin_lock(&wb->list_lock);
+	for (i = 0; i < nr; i++) {
+		struct wb_writeback_shard *shard = &shards[i];
+
+		list_splice_init(&shard->io, &wb->b_io);
+		work->nr_pages -= share - shard->wb_work.nr_pages;
+		progress += shard->progress;
+	}
+	wb->nr_io_shards--;
+	wb_io_lists_depopulated(wb);
+
+	kfree(shards);
+	return progress;
+}
+
 /*
  * Explicit flushing or periodic writeback of "old" data.
  *
@@ -1859,6 +1981,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 	unsigned long wb_start = jiffies;
 	long nr_pages = work->nr_pages;
 	unsigned long dirtied_before = jiffies;
+	unsigned int nr_workers;
 	struct inode *inode;
 	long progress;
 	struct blk_plug plug;
@@ -1904,10 +2027,11 @@ static long wb_writeback(struct bdi_writeback *wb,
 		trace_writeback_start(wb, work);
 		if (list_empty(&wb->b_io))
 			queue_io(wb, work, dirtied_before);
-		if (work->sb)
-			progress = writeback_sb_inodes(work->sb, wb, work);
+		nr_workers = READ_ONCE(wb->bdi->writeback_workers);
+		if (nr_workers > 1 && work->sync_mode == WB_SYNC_NONE)
+			progress = wb_writeback_parallel(wb, work, nr_workers);
 		else
-			progress = __writeback_inodes_wb(wb, work);
+			progress = wb_writeback_io(wb, work, &wb->b_io);
 		trace_writeback_written(wb, work);
 
 		wb_update_bandwidth(wb, wb_start);
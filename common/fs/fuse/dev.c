@@ -22,6 +22,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/vmalloc.h>
 
 #include <trace/hooks/fuse.h>
 
@@ -221,10 +222,29 @@ __releases(fiq->lock)
 	spin_unlock(&fiq->lock);
 }
 
+static bool fuse_ring_queue_request(struct fuse_conn *fc,
+				    struct fuse_req *req);
+
+/**
+ * A new request is available, hand it to the ring of the submitting CPU if
+ * there is one, else wake fiq->waitq
+ */
+static void fuse_dev_wake_pending_and_unlock(struct fuse_iqueue *fiq,
+					     bool sync)
+__releases(fiq->lock)
+{
+	struct fuse_conn *fc = container_of(fiq, struct fuse_conn, iq);
+	struct fuse_req *req = list_last_entry(&fiq->pending, struct fuse_req,
+					       list);
+
+	if (!fuse_ring_queue_request(fc, req))
+		fuse_dev_wake_and_unlock(fiq, sync);
+}
+
 const struct fuse_iqueue_ops fuse_dev_fiq_ops = {
 	.wake_forget_and_unlock		= fuse_dev_wake_and_unlock,
 	.wake_interrupt_and_unlock	= fuse_dev_wake_and_unlock,
-	.wake_pending_and_unlock	= fuse_dev_wake_and_unlock,
+	.wake_pending_and_unlock	= fuse_dev_wake_pending_and_unlock,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_fiq_ops);
 
@@ -655,6 +675,9 @@ static int unlock_request(struct fuse_req *req)
 	return err;
 }
 
+/* Max number of userspace buffer pages pinned by one fuse_copy_fill() */
+#define FUSE_COPY_BATCH 16
+
 struct fuse_copy_state {
 	int write;
 	struct fuse_req *req;
@@ -667,6 +690,13 @@ struct fuse_copy_state {
 	unsigned len;
 	unsigned offset;
 	unsigned move_pages:1;
+	/* Bytes still to be copied, if known; bounds pinning ahead */
+	size_t rem;
+	/* Userspace buffer pages pinned ahead of the current one */
+	struct page *pages[FUSE_COPY_BATCH];
+	unsigned nr_pages;
+	unsigned page_idx;
+	size_t pages_len;
 };
 
 static void fuse_copy_init(struct fuse_copy_state *cs, int write,
@@ -678,7 +708,7 @@ static void fuse_copy_init(struct fuse_copy_state *cs, int write,
 }
 
 /* Unmap and put previous page of userspace buffer */
-static void fuse_copy_finish(struct fuse_copy_state *cs)
+static void fuse_copy_put_page(struct fuse_copy_state *cs)
 {
 	if (cs->currbuf) {
 		struct pipe_buffer *buf = cs->currbuf;
@@ -700,6 +730,14 @@ static void fuse_copy_finish(struct fuse_copy_state *cs)
 	cs->pg = NULL;
 }
 
+/* Also put the pages of the userspace buffer that were pinned but not used */
+static void fuse_copy_finish(struct fuse_copy_state *cs)
+{
+	fuse_copy_put_page(cs);
+	while (cs->page_idx < cs->nr_pages)
+		put_user_page(cs->pages[cs->page_idx++]);
+}
+
 /*
  * Get another pagefull of userspace buffer, and map it to kernel
  * address space, and lock request
@@ -713,7 +751,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	if (err)
 		return err;
 
-	fuse_copy_finish(cs);
+	fuse_copy_put_page(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
 
@@ -749,15 +787,34 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 			cs->nr_segs++;
 		}
 	} else {
-		size_t off;
-		err = iov_iter_get_pages(cs->iter, &page, PAGE_SIZE, 1, &off);
-		if (err < 0)
-			return err;
-		BUG_ON(!err);
-		cs->len = err;
-		cs->offset = off;
-		cs->pg = page;
-		iov_iter_advance(cs->iter, err);
+		if (cs->page_idx == cs->nr_pages) {
+			/*
+			 * Pin as much of the buffer as the rest of the
+			 * message needs with one call, not page by page.
+			 */
+			size_t maxsize = clamp_t(size_t, cs->rem, PAGE_SIZE,
+						 FUSE_COPY_BATCH * PAGE_SIZE);
+			ssize_t len;
+			size_t off;
+
+			len = iov_iter_get_pages(cs->iter, cs->pages, maxsize,
+						 FUSE_COPY_BATCH, &off);
+			if (len < 0)
+				return len;
+			BUG_ON(!len);
+			iov_iter_advance(cs->iter, len);
+			cs->nr_pages = DIV_ROUND_UP(off + len, PAGE_SIZE);
+			cs->page_idx = 0;
+			cs->pages_len = len;
+			cs->offset = off;
+		} else {
+			cs->offset = 0;
+		}
+		cs->pg = cs->pages[cs->page_idx++];
+		cs->len = min_t(size_t, cs->pages_len,
+				PAGE_SIZE - cs->offset);
+		cs->pages_len -= cs->len;
+		cs->rem -= min_t(size_t, cs->rem, cs->len);
 	}
 
 	return lock_request(cs->req);
@@ -1316,6 +1373,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	list_add(&req->list, &fpq->io);
 	spin_unlock(&fpq->lock);
 	cs->req = req;
+	cs->rem = reqsize;
 	err = fuse_copy_one(cs, &req->in.h, sizeof(req->in.h));
 	if (!err)
 		err = fuse_copy_args(cs, args->in_numargs, args->in_pages,
@@ -1485,6 +1543,30 @@ err:
 	return err;
 }
 
+static int fuse_notify_inval_dir(struct fuse_conn *fc, unsigned int size,
+				 struct fuse_copy_state *cs)
+{
+	struct fuse_notify_inval_dir_out outarg;
+	int err = -EINVAL;
+
+	if (size != sizeof(outarg))
+		goto err;
+
+	err = fuse_copy_one(cs, &outarg, sizeof(outarg));
+	if (err)
+		goto err;
+	fuse_copy_finish(cs);
+
+	down_read(&fc->killsb);
+	err = fuse_reverse_inval_dir(fc, outarg.parent, outarg.flags);
+	up_read(&fc->killsb);
+	return err;
+
+err:
+	fuse_copy_finish(cs);
+	return err;
+}
+
 static int fuse_notify_inval_entry(struct fuse_conn *fc, unsigned int size,
 				   struct fuse_copy_state *cs)
 {
@@ -1823,6 +1905,9 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 	case FUSE_NOTIFY_DELETE:
 		return fuse_notify_delete(fc, size, cs);
 
+	case FUSE_NOTIFY_INVAL_DIR:
+		return fuse_notify_inval_dir(fc, size, cs);
+
 	default:
 		fuse_copy_finish(cs);
 		return -EINVAL;
@@ -1842,8 +1927,8 @@ static struct fuse_req *request_find(struct fuse_pqueue *fpq, u64 unique)
 	return NULL;
 }
 
-static int copy_out_args(struct fuse_copy_state *cs, struct fuse_args *args,
-			 unsigned nbytes)
+/* Check the reply size, trimming a variable length last argument to fit */
+static int fuse_check_out_args(struct fuse_args *args, unsigned nbytes)
 {
 	unsigned reqsize = sizeof(struct fuse_out_header);
 
@@ -1859,6 +1944,16 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_args *args,
 			return -EINVAL;
 		lastarg->size -= diffsize;
 	}
+	return 0;
+}
+
+static int copy_out_args(struct fuse_copy_state *cs, struct fuse_args *args,
+			 unsigned nbytes)
+{
+	int err = fuse_check_out_args(args, nbytes);
+
+	if (err)
+		return err;
 	return fuse_copy_args(cs, args->out_numargs, args->out_pages,
 			      args->out_args, args->page_zeroing);
 }
@@ -1883,6 +1978,7 @@ static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 	if (nbytes < sizeof(struct fuse_out_header))
 		goto out;
 
+	cs->rem = nbytes;
 	err = fuse_copy_one(cs, &oh, sizeof(oh));
 	if (err)
 		goto copy_finish;
@@ -1975,6 +2071,453 @@ copy_finish:
 	goto out;
 }
 
+/*
+ * Shared memory request rings.
+ *
+ * A ring is set up on a device instance and serves the requests submitted
+ * on one CPU, so that a daemon thread bound to that CPU can pick them up
+ * without a read() per request and without contending on fiq->waitq with
+ * the other threads.  Requests are copied into a free slot of the ring and
+ * hashed on the device's processing queue just like fuse_dev_do_read() does,
+ * so interrupts, aborts and device release deal with them as with any other
+ * request sent to userspace.
+ *
+ * Slots are handed out and the submission array is filled under fpq->lock,
+ * which the submitter takes before dropping fiq->lock.  Unhooking the ring
+ * from fc->rings under fiq->lock and then cycling fpq->lock is therefore
+ * enough to make sure no submitter is still using it.
+ */
+#define FUSE_RING_MAX_ENTRIES	4096
+#define FUSE_RING_MAX_SIZE	(64UL << 20)
+
+struct fuse_ring {
+	struct fuse_dev *fud;
+	unsigned int cpu;
+	unsigned int entries;
+	unsigned int slot_size;
+	size_t size;
+
+	/* Shared with userspace */
+	struct fuse_ring_header *hdr;
+	u32 *sq;
+	u32 *cq;
+	void *slots;
+
+	/* Protected by fud->pq.lock */
+	unsigned int sq_tail;
+	unsigned int nr_free;
+	u32 *free_ids;
+	struct fuse_req **reqs;
+
+	/* Protected by enter_mutex */
+	unsigned int cq_head;
+	struct mutex enter_mutex;
+
+	/* The daemon waits here for new submissions */
+	wait_queue_head_t waitq;
+};
+
+static void *fuse_ring_slot(struct fuse_ring *ring, unsigned int id)
+{
+	return ring->slots + (size_t)id * ring->slot_size;
+}
+
+/*
+ * Copy request arguments to/from a ring slot, the same way fuse_copy_args()
+ * does with a userspace buffer
+ */
+static void fuse_ring_copy_args(struct fuse_req *req, void *buf,
+				unsigned numargs, unsigned argpages,
+				struct fuse_arg *args, int zeroing, bool to_slot)
+{
+	struct fuse_args_pages *ap = container_of(req->args, typeof(*ap), args);
+	unsigned i, j;
+
+	for (i = 0; i < numargs; i++) {
+		struct fuse_arg *arg = &args[i];
+		unsigned nbytes = arg->size;
+
+		if (i < numargs - 1 || !argpages) {
+			if (to_slot)
+				memcpy(buf, arg->value, nbytes);
+			else
+				memcpy(arg->value, buf, nbytes);
+			buf += nbytes;
+			continue;
+		}
+
+		for (j = 0; j < ap->num_pages && (nbytes || zeroing); j++) {
+			struct page *page = ap->pages[j];
+			unsigned int offset = ap->descs[j].offset;
+			unsigned int count = min(nbytes, ap->descs[j].length);
+			void *mapaddr;
+
+			if (!to_slot && zeroing && count < PAGE_SIZE)
+				clear_highpage(page);
+
+			mapaddr = kmap_atomic(page);
+			if (to_slot)
+				memcpy(buf, mapaddr + offset, count);
+			else
+				memcpy(mapaddr + offset, buf, count);
+			kunmap_atomic(mapaddr);
+			if (!to_slot)
+				flush_dcache_page(page);
+
+			buf += count;
+			nbytes -= count;
+		}
+	}
+}
+
+/*
+ * Called with fiq->lock held and the request at the tail of fiq->pending.
+ * Returns true, with fiq->lock released, if the request went to a ring.
+ * Otherwise it is left for read() and fiq->lock is still held.
+ */
+static bool fuse_ring_queue_request(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_args *args = req->args;
+	struct fuse_ring *ring;
+	struct fuse_pqueue *fpq;
+	bool sync;
+	void *buf;
+	u32 id;
+
+	/* FUSE_CANONICAL_PATH needs the kern_path() lookup in the write path */
+	if (!fc->rings || !test_bit(FR_ISREPLY, &req->flags) ||
+	    args->opcode == FUSE_CANONICAL_PATH)
+		return false;
+
+	ring = fc->rings[smp_processor_id()];
+	if (!ring || req->in.h.len > ring->slot_size)
+		return false;
+
+	fpq = &ring->fud->pq;
+	spin_lock(&fpq->lock);
+	if (!fpq->connected || !ring->nr_free) {
+		spin_unlock(&fpq->lock);
+		return false;
+	}
+	clear_bit(FR_PENDING, &req->flags);
+	list_del_init(&req->list);
+	spin_unlock(&fiq->lock);
+
+	id = ring->free_ids[--ring->nr_free];
+	buf = fuse_ring_slot(ring, id);
+	memcpy(buf, &req->in.h, sizeof(req->in.h));
+	fuse_ring_copy_args(req, buf + sizeof(req->in.h), args->in_numargs,
+			    args->in_pages, (struct fuse_arg *) args->in_args,
+			    0, true);
+
+	/* One reference for the slot, dropped when the slot is reaped */
+	__fuse_get_request(req);
+	ring->reqs[id] = req;
+	list_add_tail(&req->list,
+		      &fpq->processing[fuse_req_hash(req->in.h.unique)]);
+	set_bit(FR_SENT, &req->flags);
+
+	/*
+	 * Background requests are queued under fc->bg_lock and are never
+	 * interrupted, so only synchronous ones need the reference below.
+	 */
+	sync = !test_bit(FR_BACKGROUND, &req->flags);
+	if (sync)
+		__fuse_get_request(req);
+
+	WRITE_ONCE(ring->sq[ring->sq_tail & (ring->entries - 1)], id);
+	WRITE_ONCE(ring->sq_tail, ring->sq_tail + 1);
+	smp_store_release(&ring->hdr->sq_tail, ring->sq_tail);
+	wake_up(&ring->waitq);
+	spin_unlock(&fpq->lock);
+
+	if (sync) {
+		/* matches barrier in request_wait_answer() */
+		smp_mb__after_atomic();
+		if (test_bit(FR_INTERRUPTED, &req->flags))
+			queue_interrupt(req);
+		fuse_put_request(req);
+	}
+	return true;
+}
+
+/* Finish the request whose reply was posted in slot @id */
+static void fuse_ring_complete(struct fuse_ring *ring, u32 id)
+{
+	struct fuse_pqueue *fpq = &ring->fud->pq;
+	void *buf = fuse_ring_slot(ring, id);
+	struct fuse_out_header oh;
+	struct fuse_req *req;
+	int err;
+
+	/* The slot is writable by the daemon: validate a private copy */
+	memcpy(&oh, buf, sizeof(oh));
+
+	spin_lock(&fpq->lock);
+	req = ring->reqs[id];
+	if (!req) {
+		spin_unlock(&fpq->lock);
+		return;
+	}
+	ring->reqs[id] = NULL;
+
+	/* Already ended by an abort or by a reply through write() */
+	if (!fpq->connected || !test_bit(FR_SENT, &req->flags))
+		goto out_free;
+
+	clear_bit(FR_SENT, &req->flags);
+	list_move(&req->list, &fpq->io);
+	req->out.h = oh;
+	set_bit(FR_LOCKED, &req->flags);
+	spin_unlock(&fpq->lock);
+
+	if (oh.len < sizeof(oh) || oh.len > ring->slot_size ||
+	    oh.unique != req->in.h.unique ||
+	    oh.error <= -512 || oh.error > 0)
+		err = -EINVAL;
+	else if (oh.error)
+		err = oh.len != sizeof(oh) ? -EINVAL : 0;
+	else
+		err = fuse_check_out_args(req->args, oh.len);
+
+	if (!err && !oh.error)
+		fuse_ring_copy_args(req, buf + sizeof(oh),
+				    req->args->out_numargs,
+				    req->args->out_pages,
+				    req->args->out_args,
+				    req->args->page_zeroing, false);
+
+	spin_lock(&fpq->lock);
+	clear_bit(FR_LOCKED, &req->flags);
+	if (!fpq->connected)
+		err = -ENOENT;
+	else if (err)
+		req->out.h.error = -EIO;
+	if (!test_bit(FR_PRIVATE, &req->flags))
+		list_del_init(&req->list);
+	ring->free_ids[ring->nr_free++] = id;
+	spin_unlock(&fpq->lock);
+
+	fuse_request_end(req);
+	fuse_put_request(req);
+	return;
+
+out_free:
+	ring->free_ids[ring->nr_free++] = id;
+	spin_unlock(&fpq->lock);
+	fuse_put_request(req);
+}
+
+/* Consume the completions posted by the daemon */
+static void fuse_ring_reap(struct fuse_ring *ring)
+{
+	u32 tail = smp_load_acquire(&ring->hdr->cq_tail);
+	unsigned int n;
+
+	for (n = 0; ring->cq_head != tail && n < ring->entries; n++) {
+		u32 id = READ_ONCE(ring->cq[ring->cq_head &
+					    (ring->entries - 1)]);
+
+		ring->cq_head++;
+		if (id < ring->entries)
+			fuse_ring_complete(ring, id);
+	}
+	smp_store_release(&ring->hdr->cq_head, ring->cq_head);
+}
+
+static unsigned int fuse_ring_submitted(struct fuse_ring *ring)
+{
+	u32 pending = READ_ONCE(ring->sq_tail) - READ_ONCE(ring->hdr->sq_head);
+
+	return min_t(u32, pending, ring->entries);
+}
+
+static int fuse_ring_enter(struct fuse_dev *fud, struct file *file,
+			   u32 flags)
+{
+	struct fuse_ring *ring = smp_load_acquire(&fud->ring);
+	struct fuse_pqueue *fpq = &fud->pq;
+	int err;
+
+	if (!ring)
+		return -ENODEV;
+	if (flags & ~FUSE_RING_ENTER_NOWAIT)
+		return -EINVAL;
+
+	mutex_lock(&ring->enter_mutex);
+	fuse_ring_reap(ring);
+	mutex_unlock(&ring->enter_mutex);
+
+	if (!(flags & FUSE_RING_ENTER_NOWAIT) &&
+	    !(file->f_flags & O_NONBLOCK)) {
+		err = wait_event_interruptible(ring->waitq,
+				!READ_ONCE(fpq->connected) ||
+				fuse_ring_submitted(ring));
+		if (err)
+			return err;
+	}
+	if (!READ_ONCE(fpq->connected))
+		return fud->fc->aborted ? -ECONNABORTED : -ENODEV;
+
+	return fuse_ring_submitted(ring);
+}
+
+static int fuse_ring_setup(struct fuse_dev *fud,
+			   struct fuse_ring_setup __user *argp)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_ring **rings = NULL;
+	struct fuse_ring_setup setup;
+	struct fuse_ring *ring;
+	size_t slots_off;
+	unsigned int i;
+	int err;
+
+	if (copy_from_user(&setup, argp, sizeof(setup)))
+		return -EFAULT;
+
+	if (setup.flags || setup.cpu >= nr_cpu_ids ||
+	    !cpu_possible(setup.cpu) || !is_power_of_2(setup.entries) ||
+	    setup.entries > FUSE_RING_MAX_ENTRIES ||
+	    setup.slot_size < FUSE_MIN_READ_BUFFER ||
+	    setup.slot_size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	setup.slot_size = PAGE_ALIGN(setup.slot_size);
+	setup.sq_off = sizeof(struct fuse_ring_header);
+	setup.cq_off = setup.sq_off + setup.entries * sizeof(u32);
+	slots_off = PAGE_ALIGN(setup.cq_off + setup.entries * sizeof(u32));
+	setup.slots_off = slots_off;
+	setup.ring_size = slots_off + (size_t)setup.entries * setup.slot_size;
+	setup.padding = 0;
+	if (setup.ring_size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	err = -ENOMEM;
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	ring->fud = fud;
+	ring->cpu = setup.cpu;
+	ring->entries = setup.entries;
+	ring->slot_size = setup.slot_size;
+	ring->size = setup.ring_size;
+	mutex_init(&ring->enter_mutex);
+	init_waitqueue_head(&ring->waitq);
+
+	ring->hdr = vmalloc_user(ring->size);
+	ring->reqs = kcalloc(ring->entries, sizeof(*ring->reqs), GFP_KERNEL);
+	ring->free_ids = kcalloc(ring->entries, sizeof(u32), GFP_KERNEL);
+	if (!ring->hdr || !ring->reqs || !ring->free_ids)
+		goto out_free;
+
+	ring->sq = (void *) ring->hdr + setup.sq_off;
+	ring->cq = (void *) ring->hdr + setup.cq_off;
+	ring->slots = (void *) ring->hdr + slots_off;
+	ring->hdr->entries = ring->entries;
+	ring->hdr->slot_size = ring->slot_size;
+	for (i = 0; i < ring->entries; i++)
+		ring->free_ids[i] = ring->entries - 1 - i;
+	ring->nr_free = ring->entries;
+
+	if (!READ_ONCE(fc->rings)) {
+		rings = kcalloc(nr_cpu_ids, sizeof(*rings), GFP_KERNEL);
+		if (!rings)
+			goto out_free;
+	}
+
+	err = -EBUSY;
+	spin_lock(&fiq->lock);
+	if (!fc->rings) {
+		fc->rings = rings;
+		rings = NULL;
+	}
+	if (fc->rings && !fud->ring && !fc->rings[setup.cpu]) {
+		smp_store_release(&fud->ring, ring);
+		fc->rings[setup.cpu] = ring;
+		err = 0;
+	}
+	spin_unlock(&fiq->lock);
+	kfree(rings);
+	if (err)
+		goto out_free;
+
+	if (copy_to_user(argp, &setup, sizeof(setup)))
+		return -EFAULT;
+
+	return 0;
+
+out_free:
+	kfree(ring->free_ids);
+	kfree(ring->reqs);
+	vfree(ring->hdr);
+	kfree(ring);
+	return err;
+}
+
+/* Unhook the ring of a device that is being released and free it */
+static void fuse_ring_release(struct fuse_dev *fud)
+{
+	struct fuse_ring *ring = fud->ring;
+	struct fuse_iqueue *fiq = &fud->fc->iq;
+	unsigned int i;
+
+	if (!ring)
+		return;
+
+	spin_lock(&fiq->lock);
+	if (fud->fc->rings[ring->cpu] == ring)
+		fud->fc->rings[ring->cpu] = NULL;
+	spin_unlock(&fiq->lock);
+
+	/* Wait for submitters that found the ring before it was unhooked */
+	spin_lock(&fud->pq.lock);
+	spin_unlock(&fud->pq.lock);
+
+	/* Requests still on the processing queue are ended by the caller */
+	for (i = 0; i < ring->entries; i++) {
+		if (ring->reqs[i])
+			fuse_put_request(ring->reqs[i]);
+	}
+	fud->ring = NULL;
+	kfree(ring->free_ids);
+	kfree(ring->reqs);
+	vfree(ring->hdr);
+	kfree(ring);
+}
+
+/* Called with fiq->lock held when the connection is aborted */
+static void fuse_ring_wake_all(struct fuse_conn *fc)
+{
+	unsigned int cpu;
+
+	if (!fc->rings)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		if (fc->rings[cpu])
+			wake_up_all(&fc->rings[cpu]->waitq);
+	}
+}
+
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_ring *ring;
+
+	if (!fud)
+		return -EPERM;
+
+	ring = smp_load_acquire(&fud->ring);
+	if (!ring)
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, ring->hdr, vma->vm_pgoff);
+}
+
 static ssize_t fuse_dev_write(struct kiocb *iocb, struct iov_iter *from)
 {
 	struct fuse_copy_state cs;
@@ -2205,6 +2748,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		while (forget_pending(fiq))
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
 		wake_up_all(&fiq->waitq);
+		fuse_ring_wake_all(fc);
 		spin_unlock(&fiq->lock);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 		end_polls(fc);
@@ -2235,6 +2779,8 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		LIST_HEAD(to_end);
 		unsigned int i;
 
+		fuse_ring_release(fud);
+
 		spin_lock(&fpq->lock);
 		WARN_ON(!list_empty(&fpq->io));
 		for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
@@ -2287,6 +2833,7 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int res;
 	int oldfd;
+	u32 flags;
 	struct fuse_dev *fud = NULL;
 
 	switch (cmd) {
@@ -2324,6 +2871,21 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				res = fuse_passthrough_open(fud, oldfd);
 		}
 		break;
+	case FUSE_DEV_IOC_RING_SETUP:
+		res = -EINVAL;
+		fud = fuse_get_dev(file);
+		if (fud)
+			res = fuse_ring_setup(fud, (void __user *)arg);
+		break;
+	case FUSE_DEV_IOC_RING_ENTER:
+		res = -EFAULT;
+		if (!get_user(flags, (__u32 __user *)arg)) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud)
+				res = fuse_ring_enter(fud, file, flags);
+		}
+		break;
 	default:
 		res = -ENOTTY;
 		break;
@@ -2340,6 +2902,7 @@ const struct file_operations fuse_dev_operations = {
 	.write_iter	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.mmap		= fuse_dev_mmap,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
@@ -154,9 +154,20 @@ void fuse_invalidate_atime(struct inode *inode)
  * timeout is unknown (unlink, rmdir, rename and in some cases
  * lookup)
  */
+static void fuse_drop_snapshot(struct inode *inode)
+{
+	struct fuse_inode *fi = get_fuse_inode(inode);
+
+	spin_lock(&fi->lock);
+	fi->snapshot_gen = 0;
+	spin_unlock(&fi->lock);
+}
+
 void fuse_invalidate_entry_cache(struct dentry *entry)
 {
 	fuse_dentry_settime(entry, 0);
+	if (d_really_is_positive(entry))
+		fuse_drop_snapshot(d_inode(entry));
 }
 
 /*
@@ -204,7 +215,8 @@ static int fuse_dentry_revalidate(struct dentry *entry, unsigned int flags)
 	inode = d_inode_rcu(entry);
 	if (inode && fuse_is_bad(inode))
 		goto invalid;
-	else if (time_before64(fuse_dentry_time(entry), get_jiffies_64()) ||
+	else if ((time_before64(fuse_dentry_time(entry), get_jiffies_64()) &&
+		  !(inode && fuse_snapshot_valid(entry, inode))) ||
 		 (flags & (LOOKUP_EXCL | LOOKUP_REVAL | LOOKUP_RENAME_TARGET))) {
 		struct fuse_entry_out outarg;
 		FUSE_ARGS(args);
@@ -1136,8 +1148,8 @@ static int fuse_do_getattr(struct inode *inode, struct kstat *stat,
 }
 
 static int fuse_update_get_attr(struct inode *inode, struct file *file,
-				struct kstat *stat, u32 request_mask,
-				unsigned int flags)
+				struct dentry *entry, struct kstat *stat,
+				u32 request_mask, unsigned int flags)
 {
 	struct fuse_inode *fi = get_fuse_inode(inode);
 	int err = 0;
@@ -1150,7 +1162,8 @@ static int fuse_update_get_attr(struct inode *inode, struct file *file,
 	else if (request_mask & READ_ONCE(fi->inval_mask))
 		sync = true;
 	else
-		sync = time_before64(fi->i_time, get_jiffies_64());
+		sync = time_before64(fi->i_time, get_jiffies_64()) &&
+		       !(entry && fuse_snapshot_valid(entry, inode));
 
 	if (sync) {
 		forget_all_cached_acls(inode);
@@ -1167,10 +1180,90 @@ static int fuse_update_get_attr(struct inode *inode, struct file *file,
 int fuse_update_attributes(struct inode *inode, struct file *file)
 {
 	/* Do *not* need to get atime for internal purposes */
-	return fuse_update_get_attr(inode, file, NULL,
+	return fuse_update_get_attr(inode, file,
+				    file ? file->f_path.dentry : NULL, NULL,
 				    STATX_BASIC_STATS & ~STATX_ATIME, 0);
 }
 
+/*
+ * With FUSE_DIR_SNAPSHOT, entries and attributes filled in by READDIRPLUS
+ * are stamped with the connection's snapshot generation at the time the
+ * request was sent, and stay valid past their timeouts until the directory
+ * they were listed in, or one of its ancestors for a subtree invalidation,
+ * is invalidated with a newer generation.  This costs a walk up the (cached)
+ * path, but a whole directory or subtree can be invalidated in O(1).
+ */
+bool fuse_snapshot_valid(struct dentry *entry, struct inode *inode)
+{
+	struct fuse_conn *fc = get_fuse_conn(inode);
+	struct fuse_inode *fi = get_fuse_inode(inode);
+	struct dentry *parent;
+	struct inode *dir;
+	u64 gen, parent_nodeid;
+	bool valid = false;
+
+	if (!fc->dir_snapshot)
+		return false;
+
+	spin_lock(&fi->lock);
+	gen = fi->snapshot_gen;
+	parent_nodeid = fi->snapshot_parent;
+	spin_unlock(&fi->lock);
+	if (!gen)
+		return false;
+
+	rcu_read_lock();
+	parent = READ_ONCE(entry->d_parent);
+	dir = d_inode_rcu(parent);
+	if (!dir || get_node_id(dir) != parent_nodeid ||
+	    READ_ONCE(get_fuse_inode(dir)->rdc.snapshot_inval) > gen)
+		goto out;
+
+	for (;;) {
+		fi = get_fuse_inode(dir);
+		if (READ_ONCE(fi->rdc.snapshot_subtree_inval) > gen)
+			goto out;
+		if (IS_ROOT(parent))
+			break;
+		parent = READ_ONCE(parent->d_parent);
+		dir = d_inode_rcu(parent);
+		if (!dir)
+			goto out;
+	}
+	valid = true;
+out:
+	rcu_read_unlock();
+	return valid;
+}
+
+int fuse_reverse_inval_dir(struct fuse_conn *fc, u64 parent_nodeid,
+			   u32 flags)
+{
+	struct fuse_inode *fi;
+	struct inode *parent;
+	u64 gen;
+	int err = -ENOTDIR;
+
+	if (flags & ~FUSE_INVAL_DIR_SUBTREE)
+		return -EINVAL;
+
+	parent = fuse_ilookup(fc, parent_nodeid, NULL);
+	if (!parent)
+		return -ENOENT;
+
+	if (S_ISDIR(parent->i_mode)) {
+		fi = get_fuse_inode(parent);
+		gen = atomic64_inc_return(&fc->snapshot_gen);
+		WRITE_ONCE(fi->rdc.snapshot_inval, gen);
+		if (flags & FUSE_INVAL_DIR_SUBTREE)
+			WRITE_ONCE(fi->rdc.snapshot_subtree_inval, gen);
+		fuse_dir_changed(parent);
+		err = 0;
+	}
+	iput(parent);
+	return err;
+}
+
 int fuse_reverse_inval_entry(struct fuse_conn *fc, u64 parent_nodeid,
 			     u64 child_nodeid, struct qstr *name)
 {
@@ -1899,7 +1992,8 @@ static int fuse_getattr(const struct path *path, struct kstat *stat,
 		return -EACCES;
 	}
 
-	return fuse_update_get_attr(inode, NULL, stat, request_mask, flags);
+	return fuse_update_get_attr(inode, NULL, path->dentry, stat,
+				    request_mask, flags);
 }
 
 static const struct inode_operations fuse_dir_inode_operations = {
@@ -1965,6 +2059,8 @@ void fuse_init_dir(struct inode *inode)
 	fi->rdc.size = 0;
 	fi->rdc.pos = 0;
 	fi->rdc.version = 0;
+	fi->rdc.snapshot_inval = 0;
+	fi->rdc.snapshot_subtree_inval = 0;
 }
 
 static int fuse_symlink_readpage(struct file *null, struct page *page)
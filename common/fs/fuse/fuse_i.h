@@ -35,9 +35,12 @@
 /** Default max number of pages that can be used in a single read request */
 #define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
 
-/** Maximum of max_pages received in init_out */
+/** Default maximum of max_pages received in init_out */
 #define FUSE_MAX_MAX_PAGES 256
 
+/** Upper bound of the max_pages_limit module parameter (8MiB requests) */
+#define FUSE_MAX_MAX_PAGES_LIMIT (8U << (20 - PAGE_SHIFT))
+
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
 
@@ -94,6 +97,11 @@ struct fuse_inode {
 	/** Version of last attribute change */
 	u64 attr_version;
 
+	/** Snapshot generation of the READDIRPLUS that last listed this inode,
+	    and the directory it was listed in.  Protected by fi->lock */
+	u64 snapshot_gen;
+	u64 snapshot_parent;
+
 	union {
 		/* Write related fields (regular file only) */
 		struct {
@@ -137,6 +145,11 @@ struct fuse_inode {
 
 			/* protects above fields */
 			spinlock_t lock;
+
+			/* snapshot generation of the last invalidation of
+			 * this directory, and of its whole subtree */
+			u64 snapshot_inval;
+			u64 snapshot_subtree_inval;
 		} rdc;
 	};
 
@@ -501,6 +514,9 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Shared memory request ring, if set up on this device */
+	struct fuse_ring *ring;
 };
 
 struct fuse_fs_context {
@@ -733,6 +749,9 @@ struct fuse_conn {
 	/** Does the filesystem want adaptive readdirplus? */
 	unsigned readdirplus_auto:1;
 
+	/** Does the filesystem invalidate readdirplus snapshots? */
+	unsigned dir_snapshot:1;
+
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
@@ -793,6 +812,9 @@ struct fuse_conn {
 	/** Version counter for attribute changes */
 	atomic64_t attr_version;
 
+	/** Generation counter for directory snapshot invalidations */
+	atomic64_t snapshot_gen;
+
 	/** Called on final put */
 	void (*release)(struct fuse_conn *);
 
@@ -818,6 +840,9 @@ struct fuse_conn {
 
 	/** Protects passthrough_req */
 	spinlock_t passthrough_req_lock;
+
+	/** Per-CPU request rings, indexed by CPU (protected by iq.lock) */
+	struct fuse_ring **rings;
 };
 
 /*
@@ -888,6 +913,11 @@ static inline u64 fuse_get_attr_version(struct fuse_conn *fc)
 	return atomic64_read(&fc->attr_version);
 }
 
+static inline u64 fuse_get_snapshot_gen(struct fuse_conn *fc)
+{
+	return atomic64_read(&fc->snapshot_gen);
+}
+
 static inline bool fuse_stale_inode(const struct inode *inode, int generation,
 				    struct fuse_attr *attr)
 {
@@ -1179,6 +1209,18 @@ int fuse_reverse_inval_inode(struct fuse_conn *fc, u64 nodeid,
 int fuse_reverse_inval_entry(struct fuse_conn *fc, u64 parent_nodeid,
 			     u64 child_nodeid, struct qstr *name);
 
+/**
+ * File-system tells the kernel to drop the READDIRPLUS snapshot of a
+ * directory, or of a whole subtree if FUSE_INVAL_DIR_SUBTREE is set.
+ */
+int fuse_reverse_inval_dir(struct fuse_conn *fc, u64 parent_nodeid,
+			   u32 flags);
+
+/**
+ * Is the dentry covered by a READDIRPLUS snapshot that is still valid?
+ */
+bool fuse_snapshot_valid(struct dentry *entry, struct inode *inode);
+
 int fuse_do_open(struct fuse_mount *fm, u64 nodeid, struct file *file,
 		 bool isdir);
 
@@ -51,6 +51,16 @@ MODULE_PARM_DESC(max_user_congthresh,
  "Global limit for the maximum congestion threshold an "
  "unprivileged user can set");
 
+static int set_max_pages_limit(const char *val, const struct kernel_param *kp);
+
+static unsigned max_pages_limit = FUSE_MAX_MAX_PAGES;
+module_param_call(max_pages_limit, set_max_pages_limit, param_get_uint,
+		  &max_pages_limit, 0644);
+__MODULE_PARM_TYPE(max_pages_limit, "uint");
+MODULE_PARM_DESC(max_pages_limit,
+ "Maximum number of pages in a single request a filesystem daemon can "
+ "negotiate with FUSE_MAX_PAGES");
+
 #define FUSE_SUPER_MAGIC 0x65735546
 
 #define FUSE_DEFAULT_BLKSIZE 512
@@ -83,6 +93,8 @@ static struct inode *fuse_alloc_inode(struct super_block *sb)
 	fi->nodeid = 0;
 	fi->nlookup = 0;
 	fi->attr_version = 0;
+	fi->snapshot_gen = 0;
+	fi->snapshot_parent = 0;
 	fi->orig_ino = 0;
 	fi->state = 0;
 	mutex_init(&fi->mutex);
@@ -728,11 +740,12 @@ void fuse_conn_init(struct fuse_conn *fc, struct fuse_mount *fm,
 	fc->initialized = 0;
 	fc->connected = 1;
 	atomic64_set(&fc->attr_version, 1);
+	atomic64_set(&fc->snapshot_gen, 1);
 	get_random_bytes(&fc->scramble_key, sizeof(fc->scramble_key));
 	fc->pid_ns = get_pid_ns(task_active_pid_ns(current));
 	fc->user_ns = get_user_ns(user_ns);
 	fc->max_pages = FUSE_DEFAULT_MAX_PAGES_PER_REQ;
-	fc->max_pages_limit = FUSE_MAX_MAX_PAGES;
+	fc->max_pages_limit = READ_ONCE(max_pages_limit);
 
 	INIT_LIST_HEAD(&fc->mounts);
 	list_add(&fm->fc_entry, &fc->mounts);
@@ -750,6 +763,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 			fuse_dax_conn_free(fc);
 		if (fiq->ops->release)
 			fiq->ops->release(fiq);
+		kfree(fc->rings);
 		put_pid_ns(fc->pid_ns);
 		put_user_ns(fc->user_ns);
 		fc->release(fc);
@@ -977,6 +991,22 @@ static int set_global_limit(const char *val, const struct kernel_param *kp)
 	return 0;
 }
 
+static int set_max_pages_limit(const char *val, const struct kernel_param *kp)
+{
+	unsigned int limit;
+	int rv;
+
+	rv = kstrtouint(val, 0, &limit);
+	if (rv)
+		return rv;
+
+	if (!limit || limit > FUSE_MAX_MAX_PAGES_LIMIT)
+		return -EINVAL;
+
+	*(unsigned *)kp->arg = limit;
+	return 0;
+}
+
 static void process_init_limits(struct fuse_conn *fc, struct fuse_init_out *arg)
 {
 	int cap_sys_admin = capable(CAP_SYS_ADMIN);
@@ -1022,6 +1052,10 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 		ok = false;
 	else {
 		unsigned long ra_pages;
+		u64 flags2 = 0;
+
+		if (arg->flags & FUSE_INIT_EXT)
+			flags2 = (u64) arg->flags2 << 32;
 
 		process_init_limits(fc, arg);
 
@@ -1057,6 +1091,8 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 				fc->do_readdirplus = 1;
 				if (arg->flags & FUSE_READDIRPLUS_AUTO)
 					fc->readdirplus_auto = 1;
+				if (flags2 & FUSE_DIR_SNAPSHOT)
+					fc->dir_snapshot = 1;
 			}
 			if (arg->flags & FUSE_ASYNC_DIO)
 				fc->async_dio = 1;
@@ -1101,6 +1137,12 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 
 		fm->sb->s_bdi->ra_pages =
 				min(fm->sb->s_bdi->ra_pages, ra_pages);
+		/*
+		 * Let large sequential reads grow the readahead window up to
+		 * the biggest READ the daemon accepts.
+		 */
+		fm->sb->s_bdi->io_pages = min_t(unsigned int, fc->max_pages,
+						fc->max_read / PAGE_SIZE);
 		fc->minor = arg->minor;
 		fc->max_write = arg->minor < 5 ? 4096 : arg->max_write;
 		fc->max_write = max_t(unsigned, 4096, fc->max_write);
@@ -1120,13 +1162,14 @@ static void process_init_reply(struct fuse_mount *fm, struct fuse_args *args,
 void fuse_send_init(struct fuse_mount *fm)
 {
 	struct fuse_init_args *ia;
+	u64 flags;
 
 	ia = kzalloc(sizeof(*ia), GFP_KERNEL | __GFP_NOFAIL);
 
 	ia->in.major = FUSE_KERNEL_VERSION;
 	ia->in.minor = FUSE_KERNEL_MINOR_VERSION;
 	ia->in.max_readahead = fm->sb->s_bdi->ra_pages * PAGE_SIZE;
-	ia->in.flags |=
+	flags =
 		FUSE_ASYNC_READ | FUSE_POSIX_LOCKS | FUSE_ATOMIC_O_TRUNC |
 		FUSE_EXPORT_SUPPORT | FUSE_BIG_WRITES | FUSE_DONT_MASK |
 		FUSE_SPLICE_WRITE | FUSE_SPLICE_MOVE | FUSE_SPLICE_READ |
@@ -1136,13 +1179,16 @@ void fuse_send_init(struct fuse_mount *fm)
 		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL |
 		FUSE_ABORT_ERROR | FUSE_MAX_PAGES | FUSE_CACHE_SYMLINKS |
 		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA |
-		FUSE_PASSTHROUGH;
+		FUSE_PASSTHROUGH | FUSE_INIT_EXT | FUSE_DIR_SNAPSHOT;
 #ifdef CONFIG_FUSE_DAX
 	if (fm->fc->dax)
-		ia->in.flags |= FUSE_MAP_ALIGNMENT;
+		flags |= FUSE_MAP_ALIGNMENT;
 #endif
 	if (fm->fc->auto_submounts)
-		ia->in.flags |= FUSE_SUBMOUNTS;
+		flags |= FUSE_SUBMOUNTS;
+
+	ia->in.flags = flags;
+	ia->in.flags2 = flags >> 32;
 
 	ia->args.opcode = FUSE_INIT;
 	ia->args.in_numargs = 1;
@@ -49,6 +49,10 @@ static bool page_cache_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 	struct page *page = buf->page;
 	struct address_space *mapping;
 
+	/* Only part of a compound page is ours, it can't be stolen */
+	if (pipe_buf_spans_pages(buf))
+		return false;
+
 	lock_page(page);
 
 	mapping = page_mapping(page);
@@ -349,6 +353,7 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 			    struct pipe_buffer *buf, struct splice_desc *sd)
 {
 	struct file *file = sd->u.file;
+	struct page *page = nth_page(buf->page, buf->offset >> PAGE_SHIFT);
 	loff_t pos = sd->pos;
 	int more;
 
@@ -361,7 +366,11 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 	    pipe_occupancy(pipe->head, pipe->tail) > 1)
 		more |= MSG_SENDPAGE_NOTLAST;
 
-	return file->f_op->sendpage(file, buf->page, buf->offset,
+	/*
+	 * A buffer spanning a compound page goes out as one call, so the
+	 * socket can put it into a single fragment.
+	 */
+	return file->f_op->sendpage(file, page, buf->offset & ~PAGE_MASK,
 				    sd->len, &pos, more);
 }
 
@@ -835,6 +844,12 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		 * PIPE_READERS appropriately.
 		 */
 		pipe->readers = 1;
+		/*
+		 * Nobody else sees this pipe and it is drained on every
+		 * round, so page cache buffers may span huge pages without
+		 * confusing anybody's idea of the pipe size.
+		 */
+		pipe->large_bufs = true;
 
 		current->splice_pipe = pipe;
 	}
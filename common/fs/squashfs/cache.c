@@ -10,7 +10,9 @@
 
 /*
  * Blocks in Squashfs are compressed.  To avoid repeatedly decompressing
- * recently accessed data Squashfs uses two small metadata and fragment caches.
+ * recently accessed data Squashfs uses a small per-filesystem metadata cache
+ * and a fragment cache shared by all filesystems.  Both evict the least
+ * recently used block.
  *
  * This file implements a generic cache implementation used for both caches,
  * plus functions layered ontop of the generic cache implementation to
@@ -39,12 +41,71 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/kobject.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/sysfs.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 #include "page_actor.h"
 
+static inline struct hlist_head *squashfs_cache_bucket(
+	struct squashfs_cache *cache, struct super_block *sb, u64 block)
+{
+	return &cache->hash[hash_64(block ^ (unsigned long) sb,
+				    cache->hash_bits)];
+}
+
+
+/*
+ * Caches created with a zero block size are shared between filesystems with
+ * different block sizes.  Their entries get their buffers the first time
+ * they are filled, and only ever grow.  Limit the actor to the block size of
+ * the filesystem being read so it cannot decompress more than a block.
+ */
+static int squashfs_cache_entry_alloc(struct squashfs_cache_entry *entry,
+	struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int pages = msblk->block_size >> PAGE_SHIFT;
+	void **data;
+
+	if (entry->cache->block_size)
+		return 0;
+
+	pages = pages ? pages : 1;
+
+	if (entry->pages < pages || entry->actor == NULL) {
+		int size = max(pages, entry->pages);
+
+		data = krealloc(entry->data, size * sizeof(void *), GFP_KERNEL);
+		if (data == NULL)
+			return -ENOMEM;
+
+		entry->data = data;
+		kfree(entry->actor);
+		entry->actor = NULL;
+
+		for (; entry->pages < size; entry->pages++) {
+			data[entry->pages] = kmalloc(PAGE_SIZE, GFP_KERNEL);
+			if (data[entry->pages] == NULL)
+				return -ENOMEM;
+		}
+
+		entry->actor = squashfs_page_actor_init(data, size, 0);
+		if (entry->actor == NULL)
+			return -ENOMEM;
+	}
+
+	entry->actor->pages = pages;
+	entry->actor->length = pages * PAGE_SIZE;
+	return 0;
+}
+
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -52,21 +113,18 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
+	struct hlist_head *bucket = squashfs_cache_bucket(cache, sb, block);
 	struct squashfs_cache_entry *entry;
+	int err;
 
 	spin_lock(&cache->lock);
 
 	while (1) {
-		for (i = cache->curr_blk, n = 0; n < cache->entries; n++) {
-			if (cache->entry[i].block == block) {
-				cache->curr_blk = i;
+		hlist_for_each_entry(entry, bucket, hash_node)
+			if (entry->block == block && entry->sb == sb)
 				break;
-			}
-			i = (i + 1) % cache->entries;
-		}
 
-		if (n == cache->entries) {
+		if (entry == NULL) {
 			/*
 			 * Block not in cache, if all cache entries are used
 			 * go to sleep waiting for one to become available.
@@ -81,34 +139,33 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  The least
+			 * recently used one is evicted from the cache.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
-			}
-
-			cache->next_blk = (i + 1) % cache->entries;
-			entry = &cache->entry[i];
+			entry = list_first_entry(&cache->lru,
+					struct squashfs_cache_entry, lru);
+			list_del_init(&entry->lru);
+			hlist_del_init(&entry->hash_node);
 
 			/*
 			 * Initialise chosen cache entry, and fill it in from
 			 * disk.
 			 */
 			cache->unused--;
+			cache->misses++;
 			entry->block = block;
+			entry->sb = sb;
+			hlist_add_head(&entry->hash_node, bucket);
 			entry->refcount = 1;
 			entry->pending = 1;
 			entry->num_waiters = 0;
 			entry->error = 0;
 			spin_unlock(&cache->lock);
 
-			entry->length = squashfs_read_data(sb, block, length,
-				&entry->next_index, entry->actor);
+			err = squashfs_cache_entry_alloc(entry, sb);
+			entry->length = err ? err : squashfs_read_data(sb,
+				block, length, &entry->next_index,
+				entry->actor);
 
 			spin_lock(&cache->lock);
 
@@ -137,9 +194,11 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		 * previously unused there's one less cache entry available
 		 * for reuse.
 		 */
-		entry = &cache->entry[i];
-		if (entry->refcount == 0)
+		cache->hits++;
+		if (entry->refcount == 0) {
+			list_del_init(&entry->lru);
 			cache->unused--;
+		}
 		entry->refcount++;
 
 		/*
@@ -158,7 +217,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 
 out:
 	TRACE("Got %s %d, start block %lld, refcount %d, error %d\n",
-		cache->name, i, entry->block, entry->refcount, entry->error);
+		cache->name, (int) (entry - cache->entry), entry->block,
+		entry->refcount, entry->error);
 
 	if (entry->error)
 		ERROR("Unable to read %s cache entry [%llx]\n", cache->name,
@@ -167,6 +227,19 @@ out:
 }
 
 
+/*
+ * Forget a cache entry, and make it the first to be reused.  Called with the
+ * cache lock held on an entry that is not in use.
+ */
+static void squashfs_cache_forget(struct squashfs_cache_entry *entry)
+{
+	hlist_del_init(&entry->hash_node);
+	entry->block = SQUASHFS_INVALID_BLK;
+	entry->sb = NULL;
+	list_move(&entry->lru, &entry->cache->lru);
+}
+
+
 /*
  * Release cache entry, once usage count is zero it can be reused.
  */
@@ -178,6 +251,12 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	entry->refcount--;
 	if (entry->refcount == 0) {
 		cache->unused++;
+		list_add_tail(&entry->lru, &cache->lru);
+
+		/* Don't keep failed reads around, retry them next time */
+		if (entry->error)
+			squashfs_cache_forget(entry);
+
 		/*
 		 * If there's any processes waiting for a block to become
 		 * available, wake one up.
@@ -191,6 +270,29 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_unlock(&cache->lock);
 }
 
+
+/*
+ * Drop all entries belonging to sb from the cache.  The filesystem is going
+ * away so none of them can still be in use.
+ */
+static void squashfs_cache_invalidate(struct squashfs_cache *cache,
+	struct super_block *sb)
+{
+	int i;
+
+	spin_lock(&cache->lock);
+	for (i = 0; i < cache->entries; i++) {
+		struct squashfs_cache_entry *entry = &cache->entry[i];
+
+		if (entry->sb != sb)
+			continue;
+
+		WARN_ON_ONCE(entry->refcount);
+		squashfs_cache_forget(entry);
+	}
+	spin_unlock(&cache->lock);
+}
+
 /*
  * Delete cache reclaiming all kmalloced buffers.
  */
@@ -203,13 +305,14 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 
 	for (i = 0; i < cache->entries; i++) {
 		if (cache->entry[i].data) {
-			for (j = 0; j < cache->pages; j++)
+			for (j = 0; j < cache->entry[i].pages; j++)
 				kfree(cache->entry[i].data[j]);
 			kfree(cache->entry[i].data);
 		}
 		kfree(cache->entry[i].actor);
 	}
 
+	kfree(cache->hash);
 	kfree(cache->entry);
 	kfree(cache);
 }
@@ -218,7 +321,9 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 /*
  * Initialise cache allocating the specified number of entries, each of
  * size block_size.  To avoid vmalloc fragmentation issues each entry
- * is allocated as a sequence of kmalloced PAGE_SIZE buffers.
+ * is allocated as a sequence of kmalloced PAGE_SIZE buffers.  A block_size
+ * of zero creates a cache whose entries are sized on first use, see
+ * squashfs_cache_entry_alloc().
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	int block_size)
@@ -237,8 +342,15 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		goto cleanup;
 	}
 
-	cache->curr_blk = 0;
-	cache->next_blk = 0;
+	/* Twice as many hash buckets as entries, and at least two */
+	cache->hash_bits = ilog2(roundup_pow_of_two(entries)) + 1;
+	cache->hash = kcalloc(1 << cache->hash_bits, sizeof(*cache->hash),
+		GFP_KERNEL);
+	if (cache->hash == NULL) {
+		ERROR("Failed to allocate %s cache\n", name);
+		goto cleanup;
+	}
+
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -248,6 +360,7 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	cache->num_waiters = 0;
 	spin_lock_init(&cache->lock);
 	init_waitqueue_head(&cache->wait_queue);
+	INIT_LIST_HEAD(&cache->lru);
 
 	for (i = 0; i < entries; i++) {
 		struct squashfs_cache_entry *entry = &cache->entry[i];
@@ -255,11 +368,18 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		init_waitqueue_head(&cache->entry[i].wait_queue);
 		entry->cache = cache;
 		entry->block = SQUASHFS_INVALID_BLK;
+		INIT_HLIST_NODE(&entry->hash_node);
+		list_add_tail(&entry->lru, &cache->lru);
+
+		if (block_size == 0)
+			continue;
+
 		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
 		if (entry->data == NULL) {
 			ERROR("Failed to allocate %s cache entry\n", name);
 			goto cleanup;
 		}
+		entry->pages = cache->pages;
 
 		for (j = 0; j < cache->pages; j++) {
 			entry->data[j] = kmalloc(PAGE_SIZE, GFP_KERNEL);
@@ -372,6 +492,21 @@ error:
 }
 
 
+/*
+ * Fragment blocks are shared by many small files, and so are the most likely
+ * blocks to be decompressed over and over again.  They are cached in a single
+ * LRU cache shared by all mounted filesystems, sized by the fragment_cache_size
+ * module parameter.
+ */
+static int fragment_cache_size = SQUASHFS_CACHED_FRAGMENTS;
+module_param(fragment_cache_size, int, 0444);
+MODULE_PARM_DESC(fragment_cache_size,
+	"Number of decompressed fragment blocks cached across all mounts");
+
+static struct squashfs_cache *fragment_cache;
+static struct kobject *squashfs_kobj;
+
+
 /*
  * Look-up in the fragmment cache the fragment located at <start_block> in the
  * filesystem.  If necessary read and decompress it from disk.
@@ -379,10 +514,89 @@ error:
 struct squashfs_cache_entry *squashfs_get_fragment(struct super_block *sb,
 				u64 start_block, int length)
 {
-	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	return squashfs_cache_get(sb, fragment_cache, start_block, length);
+}
+
+
+void squashfs_fragment_cache_invalidate(struct super_block *sb)
+{
+	squashfs_cache_invalidate(fragment_cache, sb);
+}
+
+
+static ssize_t fragment_cache_hits_show(struct kobject *kobj,
+	struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", READ_ONCE(fragment_cache->hits));
+}
+
+
+static ssize_t fragment_cache_misses_show(struct kobject *kobj,
+	struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", READ_ONCE(fragment_cache->misses));
+}
+
+
+static ssize_t fragment_cache_size_show(struct kobject *kobj,
+	struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", fragment_cache->entries);
+}
+
+static struct kobj_attribute fragment_cache_hits_attr =
+	__ATTR_RO(fragment_cache_hits);
+static struct kobj_attribute fragment_cache_misses_attr =
+	__ATTR_RO(fragment_cache_misses);
+static struct kobj_attribute fragment_cache_size_attr =
+	__ATTR_RO(fragment_cache_size);
+
+static struct attribute *squashfs_attrs[] = {
+	&fragment_cache_hits_attr.attr,
+	&fragment_cache_misses_attr.attr,
+	&fragment_cache_size_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group squashfs_attr_group = {
+	.attrs = squashfs_attrs,
+};
+
+
+int __init squashfs_fragment_cache_init(void)
+{
+	int err;
+
+	fragment_cache = squashfs_cache_init("fragment",
+		max(fragment_cache_size, 1), 0);
+	if (fragment_cache == NULL)
+		return -ENOMEM;
 
-	return squashfs_cache_get(sb, msblk->fragment_cache, start_block,
-		length);
+	squashfs_kobj = kobject_create_and_add("squashfs", fs_kobj);
+	if (squashfs_kobj == NULL) {
+		err = -ENOMEM;
+		goto failed;
+	}
+
+	err = sysfs_create_group(squashfs_kobj, &squashfs_attr_group);
+	if (err) {
+		kobject_put(squashfs_kobj);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	squashfs_cache_delete(fragment_cache);
+	return err;
+}
+
+
+void squashfs_fragment_cache_destroy(void)
+{
+	sysfs_remove_group(squashfs_kobj, &squashfs_attr_group);
+	kobject_put(squashfs_kobj);
+	squashfs_cache_delete(fragment_cache);
 }
 
 
@@ -23,6 +23,36 @@ struct squashfs_decompressor {
 	int	supported;
 };
 
+/*
+ * Decompressor parallelisation strategy, implemented by the
+ * decompressor_single/multi/multi_percpu.c files.
+ */
+struct squashfs_decompressor_thread_ops {
+	void	*(*create)(struct squashfs_sb_info *, void *);
+	void	(*destroy)(struct squashfs_sb_info *);
+	int	(*decompress)(struct squashfs_sb_info *, struct bio *,
+		int, int, struct squashfs_page_actor *);
+	int	(*max_decompressors)(void);
+};
+
+#if defined(CONFIG_SQUASHFS_DECOMP_SINGLE) || \
+	defined(CONFIG_SQUASHFS_DECOMP_BY_MOUNT)
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_single;
+#endif
+
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI) || \
+	defined(CONFIG_SQUASHFS_DECOMP_BY_MOUNT)
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_multi;
+#endif
+
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU) || \
+	defined(CONFIG_SQUASHFS_DECOMP_BY_MOUNT)
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_percpu;
+#endif
+
 static inline void *squashfs_comp_opts(struct squashfs_sb_info *msblk,
 							void *buff, int length)
 {
@@ -32,17 +32,14 @@ extern struct squashfs_cache_entry *squashfs_get_fragment(struct super_block *,
 extern struct squashfs_cache_entry *squashfs_get_datablock(struct super_block *,
 				u64, int);
 extern void *squashfs_read_table(struct super_block *, u64, int);
+extern void squashfs_fragment_cache_invalidate(struct super_block *);
+extern int squashfs_fragment_cache_init(void);
+extern void squashfs_fragment_cache_destroy(void);
 
 /* decompressor.c */
 extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
 extern void *squashfs_decompressor_setup(struct super_block *, unsigned short);
 
-/* decompressor_xxx.c */
-extern void *squashfs_decompressor_create(struct squashfs_sb_info *, void *);
-extern void squashfs_decompressor_destroy(struct squashfs_sb_info *);
-extern int squashfs_decompress(struct squashfs_sb_info *, struct bio *,
-				int, int, struct squashfs_page_actor *);
-extern int squashfs_max_decompressors(void);
 
 /* export.c */
 extern __le64 *squashfs_read_inode_lookup_table(struct super_block *, u64, u64,
@@ -15,26 +15,33 @@
 struct squashfs_cache {
 	char			*name;
 	int			entries;
-	int			curr_blk;
-	int			next_blk;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
 	int			pages;
+	unsigned int		hash_bits;
+	unsigned long		hits;
+	unsigned long		misses;
 	spinlock_t		lock;
 	wait_queue_head_t	wait_queue;
+	struct list_head	lru;
+	struct hlist_head	*hash;
 	struct squashfs_cache_entry *entry;
 };
 
 struct squashfs_cache_entry {
 	u64			block;
+	struct super_block	*sb;
 	int			length;
 	int			refcount;
 	u64			next_index;
 	int			pending;
 	int			error;
 	int			num_waiters;
+	int			pages;
 	wait_queue_head_t	wait_queue;
+	struct hlist_node	hash_node;
+	struct list_head	lru;
 	struct squashfs_cache	*cache;
 	void			**data;
 	struct squashfs_page_actor	*actor;
@@ -42,10 +49,10 @@ struct squashfs_cache_entry {
 
 struct squashfs_sb_info {
 	const struct squashfs_decompressor	*decompressor;
+	const struct squashfs_decompressor_thread_ops *thread_ops;
 	int					devblksize;
 	int					devblksize_log2;
 	struct squashfs_cache			*block_cache;
-	struct squashfs_cache			*fragment_cache;
 	struct squashfs_cache			*read_page;
 	int					next_meta_index;
 	__le64					*id_table;
@@ -44,6 +44,9 @@ enum wb_stat_item {
 
 #define WB_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/* upper limit for bdi->writeback_workers */
+#define WB_MAX_WORKERS	16
+
 /*
  * why some writeback work was initiated
  */
@@ -116,6 +119,7 @@ struct bdi_writeback {
 	struct list_head b_more_io;	/* parked for more writeback */
 	struct list_head b_dirty_time;	/* time stamps are dirty */
 	spinlock_t list_lock;		/* protects the b_* lists */
+	unsigned int nr_io_shards;	/* parallel rounds holding b_io inodes */
 
 	struct percpu_counter stat[NR_WB_STAT_ITEMS];
 
@@ -177,6 +181,7 @@ struct backing_dev_info {
 	unsigned int capabilities; /* Device capabilities */
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
+	unsigned int writeback_workers; /* workers per wb for async writeback */
 
 	/*
 	 * Sum of avg_write_bw of wbs with dirty inodes.  > 0 if there are
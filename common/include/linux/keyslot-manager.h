@@ -96,7 +96,7 @@ struct blk_keyslot_manager {
 	/*
 	 * Hash table which maps struct *blk_crypto_key to keyslots, so that we
 	 * can find a key's keyslot in O(1) time rather than O(num_slots).
-	 * Protected by 'lock'.
+	 * Modified under 'lock' and 'idle_slots_lock'; lookups use RCU.
 	 */
 	struct hlist_head *slot_hashtable;
 	unsigned int log_slot_ht_size;
@@ -2,8 +2,17 @@
 #ifndef _LINUX_PIPE_FS_I_H
 #define _LINUX_PIPE_FS_I_H
 
+#include <linux/sizes.h>
+
 #define PIPE_DEF_BUFFERS	16
 
+/*
+ * On a pipe with ->large_bufs set, a page cache buffer may span several
+ * subpages of a compound page, up to this many bytes.  Such a buffer still
+ * takes a single slot in the ring.
+ */
+#define PIPE_BUF_MAX_LEN	(SZ_64K > PAGE_SIZE ? SZ_64K : PAGE_SIZE)
+
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
 #define PIPE_BUF_FLAG_GIFT	0x04	/* page is a gift */
@@ -17,8 +26,9 @@
 /**
  *	struct pipe_buffer - a linux kernel pipe buffer
  *	@page: the page containing the data for the pipe buffer
- *	@offset: offset of data inside the @page
- *	@len: length of data inside the @page
+ *	@offset: offset of data inside the @page, may point past the first
+ *		subpage of a compound @page
+ *	@len: length of data inside the @page, up to %PIPE_BUF_MAX_LEN
  *	@ops: operations associated with this buffer. See @pipe_buf_operations.
  *	@flags: pipe buffer flags. See above.
  *	@private: private data owned by the ops.
@@ -41,6 +51,7 @@ struct pipe_buffer {
  *	@note_loss: The next read() should insert a data-lost message
  *	@max_usage: The maximum number of slots that may be used in the ring
  *	@ring_size: total number of buffers (should be a power of 2)
+ *	@large_bufs: page cache buffers may span several pages
  *	@nr_accounted: The amount this pipe accounts for in user->pipe_bufs
  *	@tmp_page: cached released page
  *	@readers: number of current readers of this pipe
@@ -61,6 +72,7 @@ struct pipe_inode_info {
 	unsigned int tail;
 	unsigned int max_usage;
 	unsigned int ring_size;
+	bool large_bufs;
 #ifdef CONFIG_WATCH_QUEUE
 	bool note_loss;
 #endif
@@ -190,6 +202,15 @@ static inline unsigned int pipe_space_for_user(unsigned int head, unsigned int t
 	return p_space;
 }
 
+/**
+ * pipe_buf_spans_pages - Return true if a buffer covers more than one page
+ * @buf: The pipe buffer
+ */
+static inline bool pipe_buf_spans_pages(const struct pipe_buffer *buf)
+{
+	return buf->offset + buf->len > PAGE_SIZE;
+}
+
 /**
  * pipe_buf_get - get a reference to a pipe_buffer
  * @pipe:	the pipe that the buffer belongs to
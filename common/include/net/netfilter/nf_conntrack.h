@@ -342,6 +342,14 @@ nf_ct_set(struct sk_buff *skb, struct nf_conn *ct, enum ip_conntrack_info info)
 #define NF_CT_STAT_INC_ATOMIC(net, count) this_cpu_inc((net)->ct.stat->count)
 #define NF_CT_STAT_ADD_ATOMIC(net, count, v) this_cpu_add((net)->ct.stat->count, (v))
 
+/* per-cpu lookup cache counters, see __nf_conntrack_find_get() */
+struct nf_ct_cache_stat {
+	unsigned int hit;
+	unsigned int miss;
+};
+
+#define NF_CT_CACHE_STAT_INC(net, count) this_cpu_inc((net)->ct.cache_stat->count)
+
 #define MODULE_ALIAS_NFCT_HELPER(helper) \
         MODULE_ALIAS("nfct-helper-" helper)
 
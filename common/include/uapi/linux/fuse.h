@@ -320,6 +320,12 @@ struct fuse_file_lock {
  *		       foffset and moffset fields in struct
  *		       fuse_setupmapping_out and fuse_removemapping_one.
  * FUSE_SUBMOUNTS: kernel supports auto-mounting directory submounts
+ * FUSE_INIT_EXT: extended fuse_init_in request, flags2 is valid
+ *
+ * Android private, in the top bit of flags2 to stay clear of upstream:
+ * FUSE_DIR_SNAPSHOT: entries and attributes returned by READDIRPLUS stay valid
+ *		      past their timeouts until the directory is invalidated
+ *		      with FUSE_NOTIFY_INVAL_DIR
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -349,7 +355,10 @@ struct fuse_file_lock {
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
 #define FUSE_SUBMOUNTS		(1 << 27)
+#define FUSE_INIT_EXT		(1 << 30)
 #define FUSE_PASSTHROUGH	(1 << 31)
+/* bits 32..63 get shifted down 32 bits into the flags2 field */
+#define FUSE_DIR_SNAPSHOT	(1ULL << 63)
 
 /**
  * CUSE INIT request/reply flags
@@ -498,6 +507,9 @@ enum fuse_notify_code {
 	FUSE_NOTIFY_RETRIEVE = 5,
 	FUSE_NOTIFY_DELETE = 6,
 	FUSE_NOTIFY_CODE_MAX,
+
+	/* Android private, clear of the upstream range */
+	FUSE_NOTIFY_INVAL_DIR = 126,
 };
 
 /* The read buffer is required to be at least 8k, but may be much larger */
@@ -700,6 +712,8 @@ struct fuse_init_in {
 	uint32_t	minor;
 	uint32_t	max_readahead;
 	uint32_t	flags;
+	uint32_t	flags2;
+	uint32_t	unused[11];
 };
 
 #define FUSE_COMPAT_INIT_OUT_SIZE 8
@@ -716,7 +730,8 @@ struct fuse_init_out {
 	uint32_t	time_gran;
 	uint16_t	max_pages;
 	uint16_t	map_alignment;
-	uint32_t	unused[8];
+	uint32_t	flags2;
+	uint32_t	unused[7];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -859,6 +874,18 @@ struct fuse_notify_delete_out {
 	uint32_t	padding;
 };
 
+/**
+ * Invalidate the READDIRPLUS snapshot of a directory, and of all directories
+ * below it with FUSE_INVAL_DIR_SUBTREE
+ */
+#define FUSE_INVAL_DIR_SUBTREE	(1 << 0)
+
+struct fuse_notify_inval_dir_out {
+	uint64_t	parent;
+	uint32_t	flags;
+	uint32_t	padding;
+};
+
 struct fuse_notify_store_out {
 	uint64_t	nodeid;
 	uint64_t	offset;
@@ -890,6 +917,51 @@ struct fuse_notify_retrieve_in {
 /* 127 is reserved for the V1 interface implementation in Android (deprecated) */
 /* 126 is reserved for the V2 interface implementation in Android */
 #define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 126, __u32)
+/* 128 and up are Android private, clear of the numbers upstream allocates */
+#define FUSE_DEV_IOC_RING_SETUP		_IOWR(FUSE_DEV_IOC_MAGIC, 128, \
+					      struct fuse_ring_setup)
+#define FUSE_DEV_IOC_RING_ENTER		_IOW(FUSE_DEV_IOC_MAGIC, 129, uint32_t)
+
+/*
+ * Shared memory request ring, bound to one CPU of the submitting tasks.
+ *
+ * FUSE_DEV_IOC_RING_SETUP on a (cloned) device fd allocates the ring; the
+ * daemon then mmap()s ring_size bytes at offset 0 of the same fd.  The
+ * mapping starts with a struct fuse_ring_header, followed by the submission
+ * and completion arrays of slot indexes and, at slots_off, 'entries' slots of
+ * 'slot_size' bytes each.
+ *
+ * A slot posted on the submission array holds a request exactly as read()
+ * would have returned it.  The daemon overwrites the slot with the reply, in
+ * the format write() expects, and posts the slot index on the completion
+ * array.  FUSE_DEV_IOC_RING_ENTER consumes completions and, unless
+ * FUSE_RING_ENTER_NOWAIT is given, sleeps until new submissions arrive.
+ *
+ * Requests that do not fit a slot, and all FORGET and INTERRUPT requests,
+ * keep going through read()/write() on the device.
+ */
+struct fuse_ring_setup {
+	uint32_t	cpu;
+	uint32_t	entries;
+	uint32_t	slot_size;
+	uint32_t	flags;
+	uint64_t	ring_size;
+	uint32_t	sq_off;
+	uint32_t	cq_off;
+	uint32_t	slots_off;
+	uint32_t	padding;
+};
+
+struct fuse_ring_header {
+	uint32_t	sq_head;	/* written by the daemon */
+	uint32_t	sq_tail;	/* written by the kernel */
+	uint32_t	cq_head;	/* written by the kernel */
+	uint32_t	cq_tail;	/* written by the daemon */
+	uint32_t	entries;
+	uint32_t	slot_size;
+};
+
+#define FUSE_RING_ENTER_NOWAIT	(1 << 0)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -372,6 +372,36 @@ Bad:
 #define sanity(i) true
 #endif
 
+/*
+ * Check whether @page/@offset continues the page cache data referenced by
+ * @buf, either within the same page or, on a pipe with ->large_bufs, in the
+ * next subpage of the same compound page.  The latter lets one buffer cover
+ * up to PIPE_BUF_MAX_LEN of a huge page instead of taking a slot per
+ * subpage.  Highmem pages are left alone, since users of the buffer kmap()
+ * @buf->page only.
+ */
+static bool pipe_buf_continues(const struct pipe_inode_info *pipe,
+			       const struct pipe_buffer *buf,
+			       struct page *page, size_t offset, size_t bytes)
+{
+	size_t end = buf->offset + buf->len;
+
+	if (buf->page == page)
+		return offset == end;
+
+	if (!pipe->large_bufs || buf->ops != &page_cache_pipe_buf_ops)
+		return false;
+	if (!PageCompound(page) || PageHighMem(page) ||
+	    compound_head(page) != compound_head(buf->page))
+		return false;
+	if (page_to_pfn(page) < page_to_pfn(buf->page))
+		return false;
+	if (((page_to_pfn(page) - page_to_pfn(buf->page)) << PAGE_SHIFT) +
+	    offset != end)
+		return false;
+	return buf->len + bytes <= PIPE_BUF_MAX_LEN;
+}
+
 static size_t copy_page_to_iter_pipe(struct page *page, size_t offset, size_t bytes,
 			 struct iov_iter *i)
 {
@@ -394,7 +424,7 @@ static size_t copy_page_to_iter_pipe(struct page *page, size_t offset, size_t by
 	off = i->iov_offset;
 	buf = &pipe->bufs[i_head & p_mask];
 	if (off) {
-		if (offset == off && buf->page == page) {
+		if (pipe_buf_continues(pipe, buf, page, offset, bytes)) {
 			/* merge with the last one */
 			buf->len += bytes;
 			i->iov_offset += bytes;
@@ -31,6 +31,11 @@ LIST_HEAD(bdi_list);
 
 /* bdi_wq serves all asynchronous writeback tasks */
 struct workqueue_struct *bdi_wq;
+/*
+ * bdi_shard_wq runs the shards of a parallel writeback round.  The flusher
+ * waits for them from bdi_wq, so they need a rescuer of their own.
+ */
+struct workqueue_struct *bdi_shard_wq;
 
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
@@ -198,6 +203,26 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t writeback_workers_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	unsigned int workers;
+	ssize_t ret;
+
+	ret = kstrtouint(buf, 10, &workers);
+	if (ret < 0)
+		return ret;
+
+	if (!workers || workers > WB_MAX_WORKERS)
+		return -EINVAL;
+
+	WRITE_ONCE(bdi->writeback_workers, workers);
+
+	return count;
+}
+BDI_SHOW(writeback_workers, bdi->writeback_workers)
+
 static ssize_t stable_pages_required_show(struct device *dev,
 					  struct device_attribute *attr,
 					  char *page)
@@ -212,6 +237,7 @@ static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_read_ahead_kb.attr,
 	&dev_attr_min_ratio.attr,
 	&dev_attr_max_ratio.attr,
+	&dev_attr_writeback_workers.attr,
 	&dev_attr_stable_pages_required.attr,
 	NULL,
 };
@@ -241,6 +267,11 @@ static int __init default_bdi_init(void)
 	if (!bdi_wq)
 		return -ENOMEM;
 
+	bdi_shard_wq = alloc_workqueue("writeback_shard",
+				       WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!bdi_shard_wq)
+		return -ENOMEM;
+
 	err = bdi_init(&noop_backing_dev_info);
 
 	return err;
@@ -730,6 +761,7 @@ static int bdi_init(struct backing_dev_info *bdi)
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = FPROP_FRAC_BASE;
+	bdi->writeback_workers = 1;
 	INIT_LIST_HEAD(&bdi->bdi_list);
 	INIT_LIST_HEAD(&bdi->wb_list);
 	init_waitqueue_head(&bdi->wb_waitq);
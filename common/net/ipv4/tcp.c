@@ -1857,34 +1857,84 @@ static int tcp_zerocopy_handle_leftover_data(struct tcp_zerocopy_receive *zc,
 	return zc->copybuf_len < 0 ? 0 : copylen;
 }
 
+static int tcp_zerocopy_vm_insert_batch_error(struct vm_area_struct *vma,
+					      struct page **pending_pages,
+					      unsigned long pages_remaining,
+					      unsigned long *address,
+					      u32 *length,
+					      u32 *seq,
+					      struct tcp_zerocopy_receive *zc,
+					      u32 total_bytes_to_map,
+					      int err)
+{
+	/* At least one page did not map. Try zapping if we skipped earlier. */
+	if (err == -EBUSY &&
+	    zc->flags & TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT) {
+		u32 maybe_zap_len;
+
+		maybe_zap_len = total_bytes_to_map -  /* All bytes to map */
+				*length + /* Mapped or pending */
+				(pages_remaining * PAGE_SIZE); /* Failed map. */
+		zap_page_range(vma, *address, maybe_zap_len);
+		err = 0;
+	}
+
+	if (!err) {
+		unsigned long leftover_pages = pages_remaining;
+		int bytes_mapped;
+
+		/* We called zap_page_range, try to reinsert. */
+		err = vm_insert_pages(vma, *address,
+				      pending_pages,
+				      &pages_remaining);
+		bytes_mapped = PAGE_SIZE * (leftover_pages - pages_remaining);
+		*seq += bytes_mapped;
+		*address += bytes_mapped;
+	}
+	if (err) {
+		/* Either we were unable to zap, OR we zapped, retried an
+		 * insert, and still had an issue. Either ways, pages_remaining
+		 * is the number of pages we were unable to map, and we unroll
+		 * some state we speculatively touched before.
+		 */
+		const int bytes_not_mapped = PAGE_SIZE * pages_remaining;
+
+		*length -= bytes_not_mapped;
+		zc->recv_skip_hint += bytes_not_mapped;
+	}
+	return err;
+}
+
 static int tcp_zerocopy_vm_insert_batch(struct vm_area_struct *vma,
 					struct page **pages,
 					unsigned long pages_to_map,
-					unsigned long *insert_addr,
-					u32 *length_with_pending,
+					unsigned long *address,
+					u32 *length,
 					u32 *seq,
-					struct tcp_zerocopy_receive *zc)
+					struct tcp_zerocopy_receive *zc,
+					u32 total_bytes_to_map)
 {
 	unsigned long pages_remaining = pages_to_map;
-	int bytes_mapped;
-	int ret;
+	unsigned int pages_mapped;
+	unsigned int bytes_mapped;
+	int err;
 
-	ret = vm_insert_pages(vma, *insert_addr, pages, &pages_remaining);
-	bytes_mapped = PAGE_SIZE * (pages_to_map - pages_remaining);
+	err = vm_insert_pages(vma, *address, pages, &pages_remaining);
+	pages_mapped = pages_to_map - (unsigned int)pages_remaining;
+	bytes_mapped = PAGE_SIZE * pages_mapped;
 	/* Even if vm_insert_pages fails, it may have partially succeeded in
 	 * mapping (some but not all of the pages).
 	 */
 	*seq += bytes_mapped;
-	*insert_addr += bytes_mapped;
-	if (ret) {
-		/* But if vm_insert_pages did fail, we have to unroll some state
-		 * we speculatively touched before.
-		 */
-		const int bytes_not_mapped = PAGE_SIZE * pages_remaining;
-		*length_with_pending -= bytes_not_mapped;
-		zc->recv_skip_hint += bytes_not_mapped;
-	}
-	return ret;
+	*address += bytes_mapped;
+
+	if (likely(!err))
+		return 0;
+
+	/* Error: maybe zap and retry + rollback state for failed inserts. */
+	return tcp_zerocopy_vm_insert_batch_error(vma, pages + pages_mapped,
+		pages_remaining, address, length, seq, zc, total_bytes_to_map,
+		err);
 }
 
 static int tcp_zerocopy_receive(struct sock *sk,
@@ -1910,6 +1960,9 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	if (address & (PAGE_SIZE - 1) || address != zc->address)
 		return -EINVAL;
 
+	if (zc->flags & ~TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT)
+		return -EINVAL;
+
 	if (sk->sk_state == TCP_LISTEN)
 		return -ENOTCONN;
 
@@ -1926,7 +1979,12 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	avail_len = min_t(u32, vma_len, inq);
 	aligned_len = avail_len & ~(PAGE_SIZE - 1);
 	if (aligned_len) {
-		zap_page_range(vma, address, aligned_len);
+		/* With the hint, userspace promises the range is usually
+		 * unmapped (a recycled buffer it already released), so skip
+		 * the up-front zap and only zap on -EBUSY from insertion.
+		 */
+		if (!(zc->flags & TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT))
+			zap_page_range(vma, address, aligned_len);
 		zc->length = aligned_len;
 		zc->recv_skip_hint = 0;
 	} else {
@@ -1947,7 +2005,8 @@ static int tcp_zerocopy_receive(struct sock *sk,
 								   pg_idx,
 								   &curr_addr,
 								   &length,
-								   &seq, zc);
+								   &seq, zc,
+								   aligned_len);
 				if (ret)
 					goto out;
 				pg_idx = 0;
@@ -1980,7 +2039,7 @@ static int tcp_zerocopy_receive(struct sock *sk,
 		if (pg_idx == PAGE_BATCH_SIZE) {
 			ret = tcp_zerocopy_vm_insert_batch(vma, pages, pg_idx,
 							   &curr_addr, &length,
-							   &seq, zc);
+							   &seq, zc, aligned_len);
 			if (ret)
 				goto out;
 			pg_idx = 0;
@@ -1989,7 +2048,7 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	if (pg_idx) {
 		ret = tcp_zerocopy_vm_insert_batch(vma, pages, pg_idx,
 						   &curr_addr, &length, &seq,
-						   zc);
+						   zc, aligned_len);
 	}
 out:
 	mmap_read_unlock(current->mm);
@@ -769,6 +769,94 @@ begin:
 	return NULL;
 }
 
+/* Small per-cpu direct mapped cache of recent lookup results, consulted
+ * before walking the hash table.  Slots hold no reference: a hit is
+ * revalidated exactly like a hash chain candidate, and nf_conntrack_free()
+ * clears every slot still pointing at the object before it is returned to
+ * the (SLAB_TYPESAFE_BY_RCU) cache, so a slot never outlives its slab page.
+ */
+#define NF_CT_LOOKUP_CACHE_SIZE	256
+
+struct nf_ct_lookup_slot {
+	struct nf_conntrack_tuple_hash *h;
+	u32 hash;
+};
+
+struct nf_ct_lookup_cache {
+	struct nf_ct_lookup_slot slot[NF_CT_LOOKUP_CACHE_SIZE];
+};
+
+static struct nf_ct_lookup_cache __percpu *nf_ct_lookup_cache __read_mostly;
+
+static struct nf_ct_lookup_slot *nf_ct_lookup_slot(int cpu, u32 hash)
+{
+	return &per_cpu_ptr(nf_ct_lookup_cache, cpu)->slot[hash &
+					(NF_CT_LOOKUP_CACHE_SIZE - 1)];
+}
+
+/* Caller must hold rcu readlock.  Returns a referenced entry or NULL. */
+static struct nf_conntrack_tuple_hash *
+nf_ct_lookup_cache_get(struct net *net, const struct nf_conntrack_zone *zone,
+		       const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct nf_ct_lookup_slot *slot;
+	struct nf_conn *ct;
+
+	/* Process context lookups may migrate; any cpu's slot is fine. */
+	slot = nf_ct_lookup_slot(raw_smp_processor_id(), hash);
+	h = READ_ONCE(slot->h);
+	if (!h || READ_ONCE(slot->hash) != hash)
+		goto miss;
+
+	ct = nf_ct_tuplehash_to_ctrack(h);
+	if (unlikely(!atomic_inc_not_zero(&ct->ct_general.use)))
+		goto miss;
+
+	/* Entries unlinked from the table must not be handed out again. */
+	if (likely(nf_ct_key_equal(h, tuple, zone, net) &&
+		   !nf_ct_is_dying(ct) && !nf_ct_is_expired(ct))) {
+		NF_CT_CACHE_STAT_INC(net, hit);
+		return h;
+	}
+
+	nf_ct_put(ct);
+miss:
+	NF_CT_CACHE_STAT_INC(net, miss);
+	return NULL;
+}
+
+/* Caller must hold a reference on the entry; the store is then ordered
+ * before the final put and thus before nf_ct_lookup_cache_evict().
+ */
+static void nf_ct_lookup_cache_set(struct nf_conntrack_tuple_hash *h, u32 hash)
+{
+	struct nf_ct_lookup_slot *slot;
+
+	slot = nf_ct_lookup_slot(raw_smp_processor_id(), hash);
+	WRITE_ONCE(slot->hash, hash);
+	WRITE_ONCE(slot->h, h);
+}
+
+static void nf_ct_lookup_cache_evict(struct nf_conn *ct)
+{
+	struct net *net = nf_ct_net(ct);
+	int cpu, dir;
+
+	for (dir = 0; dir < IP_CT_DIR_MAX; dir++) {
+		struct nf_conntrack_tuple_hash *h = &ct->tuplehash[dir];
+		u32 hash = hash_conntrack_raw(&h->tuple, net);
+
+		for_each_possible_cpu(cpu) {
+			struct nf_ct_lookup_slot *slot;
+
+			slot = nf_ct_lookup_slot(cpu, hash);
+			if (READ_ONCE(slot->h) == h)
+				cmpxchg(&slot->h, h, NULL);
+		}
+	}
+}
+
 /* Find a connection corresponding to a tuple. */
 static struct nf_conntrack_tuple_hash *
 __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
@@ -779,6 +867,10 @@ __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 
 	rcu_read_lock();
 
+	h = nf_ct_lookup_cache_get(net, zone, tuple, hash);
+	if (h)
+		goto found;
+
 	h = ____nf_conntrack_find(net, zone, tuple, hash);
 	if (h) {
 		/* We have a candidate that matches the tuple we're interested
@@ -786,8 +878,10 @@ __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 		 */
 		ct = nf_ct_tuplehash_to_ctrack(h);
 		if (likely(atomic_inc_not_zero(&ct->ct_general.use))) {
-			if (likely(nf_ct_key_equal(h, tuple, zone, net)))
+			if (likely(nf_ct_key_equal(h, tuple, zone, net))) {
+				nf_ct_lookup_cache_set(h, hash);
 				goto found;
+			}
 
 			/* TYPESAFE_BY_RCU recycled the candidate */
 			nf_ct_put(ct);
@@ -1525,6 +1619,10 @@ void nf_conntrack_free(struct nf_conn *ct)
 	 */
 	WARN_ON(atomic_read(&ct->ct_general.use) != 0);
 
+	/* Only confirmed entries can have been cached by a lookup. */
+	if (nf_ct_is_confirmed(ct))
+		nf_ct_lookup_cache_evict(ct);
+
 	nf_ct_ext_destroy(ct);
 	kmem_cache_free(nf_conntrack_cachep, ct);
 	smp_mb__before_atomic();
@@ -2384,6 +2482,7 @@ void nf_conntrack_cleanup_end(void)
 	nf_conntrack_acct_fini();
 	nf_conntrack_expect_fini();
 
+	free_percpu(nf_ct_lookup_cache);
 	kmem_cache_destroy(nf_conntrack_cachep);
 }
 
@@ -2426,6 +2525,7 @@ i_see_dead_people:
 		nf_conntrack_proto_pernet_fini(net);
 		nf_conntrack_ecache_pernet_fini(net);
 		nf_conntrack_expect_pernet_fini(net);
+		free_percpu(net->ct.cache_stat);
 		free_percpu(net->ct.stat);
 		free_percpu(net->ct.pcpu_lists);
 	}
@@ -2614,6 +2714,10 @@ int nf_conntrack_init_start(void)
 	if (!nf_conntrack_cachep)
 		goto err_cachep;
 
+	nf_ct_lookup_cache = alloc_percpu(struct nf_ct_lookup_cache);
+	if (!nf_ct_lookup_cache)
+		goto err_lookup_cache;
+
 	ret = nf_conntrack_expect_init();
 	if (ret < 0)
 		goto err_expect;
@@ -2672,6 +2776,8 @@ err_tstamp:
 err_acct:
 	nf_conntrack_expect_fini();
 err_expect:
+	free_percpu(nf_ct_lookup_cache);
+err_lookup_cache:
 	kmem_cache_destroy(nf_conntrack_cachep);
 err_cachep:
 	kvfree(nf_conntrack_hash);
@@ -2722,6 +2828,10 @@ int nf_conntrack_init_net(struct net *net)
 	if (!net->ct.stat)
 		goto err_pcpu_lists;
 
+	net->ct.cache_stat = alloc_percpu(struct nf_ct_cache_stat);
+	if (!net->ct.cache_stat)
+		goto err_cache_stat;
+
 	ret = nf_conntrack_expect_pernet_init(net);
 	if (ret < 0)
 		goto err_expect;
@@ -2735,6 +2845,8 @@ int nf_conntrack_init_net(struct net *net)
 	return 0;
 
 err_expect:
+	free_percpu(net->ct.cache_stat);
+err_cache_stat:
 	free_percpu(net->ct.stat);
 err_pcpu_lists:
 	free_percpu(net->ct.pcpu_lists);
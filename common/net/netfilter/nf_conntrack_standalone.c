@@ -464,6 +464,63 @@ static const struct seq_operations ct_cpu_seq_ops = {
 	.show	= ct_cpu_seq_show,
 };
 
+static void *ct_cache_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct net *net = seq_file_net(seq);
+	int cpu;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+
+	for (cpu = *pos-1; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return per_cpu_ptr(net->ct.cache_stat, cpu);
+	}
+
+	return NULL;
+}
+
+static void *ct_cache_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct net *net = seq_file_net(seq);
+	int cpu;
+
+	for (cpu = *pos; cpu < nr_cpu_ids; ++cpu) {
+		if (!cpu_possible(cpu))
+			continue;
+		*pos = cpu + 1;
+		return per_cpu_ptr(net->ct.cache_stat, cpu);
+	}
+	(*pos)++;
+	return NULL;
+}
+
+static void ct_cache_seq_stop(struct seq_file *seq, void *v)
+{
+}
+
+static int ct_cache_seq_show(struct seq_file *seq, void *v)
+{
+	const struct nf_ct_cache_stat *st = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(seq, "hit      miss\n");
+		return 0;
+	}
+
+	seq_printf(seq, "%08x %08x\n", st->hit, st->miss);
+	return 0;
+}
+
+static const struct seq_operations ct_cache_seq_ops = {
+	.start	= ct_cache_seq_start,
+	.next	= ct_cache_seq_next,
+	.stop	= ct_cache_seq_stop,
+	.show	= ct_cache_seq_show,
+};
+
 static int nf_conntrack_standalone_init_proc(struct net *net)
 {
 	struct proc_dir_entry *pde;
@@ -484,8 +541,15 @@ static int nf_conntrack_standalone_init_proc(struct net *net)
 			&ct_cpu_seq_ops, sizeof(struct seq_net_private));
 	if (!pde)
 		goto out_stat_nf_conntrack;
+
+	pde = proc_create_net("nf_conntrack_cache", 0444, net->proc_net_stat,
+			&ct_cache_seq_ops, sizeof(struct seq_net_private));
+	if (!pde)
+		goto out_stat_nf_conntrack_cache;
 	return 0;
 
+out_stat_nf_conntrack_cache:
+	remove_proc_entry("nf_conntrack", net->proc_net_stat);
 out_stat_nf_conntrack:
 	remove_proc_entry("nf_conntrack", net->proc_net);
 out_nf_conntrack:
@@ -494,6 +558,7 @@ out_nf_conntrack:
 
 static void nf_conntrack_standalone_fini_proc(struct net *net)
 {
+	remove_proc_entry("nf_conntrack_cache", net->proc_net_stat);
 	remove_proc_entry("nf_conntrack", net->proc_net_stat);
 	remove_proc_entry("nf_conntrack", net->proc_net);
 }
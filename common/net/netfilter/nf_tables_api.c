@@ -3752,6 +3752,7 @@ static const struct nft_set_type *nft_set_types[] = {
 	&nft_set_rbtree_type,
 #if defined(CONFIG_X86_64) && !defined(CONFIG_UML)
 	&nft_set_pipapo_avx2_type,
+	&nft_set_pipapo_sse2_type,
 #endif
 	&nft_set_pipapo_type,
 };
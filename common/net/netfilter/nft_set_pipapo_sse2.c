@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: SSE2 packet lookup routines
+ *
+ * Baseline x86-64 counterpart of the AVX2 lookup routines: same algorithm as
+ * nft_pipapo_lookup(), with bucket intersection done on 128-bit vectors.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <linux/compiler.h>
+#include <asm/fpu/api.h>
+
+#include "nft_set_pipapo_avx2.h"
+#include "nft_set_pipapo_sse2.h"
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_LONGS_PER_M128	(128 / BITS_PER_LONG)
+
+/* Load 128 bits from memory into XMM register. Buckets are aligned to
+ * NFT_PIPAPO_ALIGN, which is a multiple of 16 bytes, and so is the bucket
+ * size, so aligned moves can always be used.
+ */
+#define NFT_PIPAPO_SSE2_LOAD(reg, loc)					\
+	asm volatile("movdqa %0, %%xmm" #reg : : "m" (loc))
+
+/* Bitwise AND of XMM register with 128 bits from memory */
+#define NFT_PIPAPO_SSE2_AND(reg, loc)					\
+	asm volatile("pand %0, %%xmm" #reg : : "m" (loc))
+
+/* Store 128 bits from XMM register into memory */
+#define NFT_PIPAPO_SSE2_STORE(loc, reg)					\
+	asm volatile("movdqa %%xmm" #reg ", %0" : "=m" (loc))
+
+/**
+ * nft_pipapo_sse2_and_4b() - Intersect 4-bit buckets, 128 bits at a time
+ * @f:		Field including lookup table
+ * @map:	Previous match result, intersected in place
+ * @pkt:	Packet data, pointer to input nftables register
+ *
+ * Contrary to pipapo_and_field_buckets_4bit(), iterate over 128-bit slices
+ * of the bitmap first, and over groups for each slice, so that the partial
+ * result stays in a register and is stored once per slice. Slices that are
+ * already empty are skipped, which is common past the first field.
+ */
+static void nft_pipapo_sse2_and_4b(const struct nft_pipapo_field *f,
+				   unsigned long *map, const u8 *pkt)
+{
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned long bsize = f->bsize;
+	int i, group;
+
+	for (i = 0; i < bsize; i += NFT_PIPAPO_LONGS_PER_M128) {
+		const unsigned long *l = lt + i;
+		const u8 *data = pkt;
+
+		if (!map[i] && !map[i + 1])
+			continue;
+
+		NFT_PIPAPO_SSE2_LOAD(0, map[i]);
+		for (group = 0; group < f->groups; group += 2, data++) {
+			NFT_PIPAPO_SSE2_AND(0, l[(*data >> 4) * bsize]);
+			l += bsize * NFT_PIPAPO_BUCKETS(4);
+
+			NFT_PIPAPO_SSE2_AND(0, l[(*data & 0x0f) * bsize]);
+			l += bsize * NFT_PIPAPO_BUCKETS(4);
+		}
+		NFT_PIPAPO_SSE2_STORE(map[i], 0);
+	}
+}
+
+/**
+ * nft_pipapo_sse2_and_8b() - Intersect 8-bit buckets, 128 bits at a time
+ * @f:		Field including lookup table
+ * @map:	Previous match result, intersected in place
+ * @pkt:	Packet data, pointer to input nftables register
+ *
+ * See nft_pipapo_sse2_and_4b().
+ */
+static void nft_pipapo_sse2_and_8b(const struct nft_pipapo_field *f,
+				   unsigned long *map, const u8 *pkt)
+{
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned long bsize = f->bsize;
+	int i, group;
+
+	for (i = 0; i < bsize; i += NFT_PIPAPO_LONGS_PER_M128) {
+		const unsigned long *l = lt + i;
+		const u8 *data = pkt;
+
+		if (!map[i] && !map[i + 1])
+			continue;
+
+		NFT_PIPAPO_SSE2_LOAD(0, map[i]);
+		for (group = 0; group < f->groups; group++, data++) {
+			NFT_PIPAPO_SSE2_AND(0, l[*data * bsize]);
+			l += bsize * NFT_PIPAPO_BUCKETS(8);
+		}
+		NFT_PIPAPO_SSE2_STORE(map[i], 0);
+	}
+}
+
+/**
+ * nft_pipapo_sse2_estimate() - Set size, space and lookup complexity
+ * @desc:	Set description, element count and field description used
+ * @features:	Flags: NFT_SET_INTERVAL needs to be there
+ * @est:	Storage for estimation data
+ *
+ * This is only reached if the AVX2 implementation declined the set, as both
+ * report the same figures and the AVX2 type is listed first.
+ *
+ * Return: true if set is compatible and SSE2 available, false otherwise.
+ */
+bool nft_pipapo_sse2_estimate(const struct nft_set_desc *desc, u32 features,
+			      struct nft_set_estimate *est)
+{
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS)
+		return false;
+
+	if (!boot_cpu_has(X86_FEATURE_XMM2))
+		return false;
+
+	est->size = pipapo_estimate_size(desc);
+	if (!est->size)
+		return false;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+
+	est->space = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+/**
+ * nft_pipapo_sse2_lookup() - Lookup function for SSE2 implementation
+ * @net:	Network namespace
+ * @set:	nftables API set representation
+ * @elem:	nftables API element representation containing key data
+ * @ext:	nftables API extension pointer, filled with matching reference
+ *
+ * For more details, see DOC: Theory of Operation in nft_set_pipapo.c.
+ *
+ * This follows nft_pipapo_lookup() step by step, only replacing the bucket
+ * intersection with the 128-bit versions above.
+ *
+ * Return: true on match, false otherwise.
+ */
+bool nft_pipapo_sse2_lookup(const struct net *net, const struct nft_set *set,
+			    const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_scratch *scratch;
+	unsigned long *res_map, *fill_map;
+	u8 genmask = nft_genmask_cur(net);
+	const u8 *rp = (const u8 *)key;
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	bool map_index;
+	int i;
+
+	local_bh_disable();
+
+	if (unlikely(!irq_fpu_usable())) {
+		bool fallback_res = nft_pipapo_lookup(net, set, key, ext);
+
+		local_bh_enable();
+		return fallback_res;
+	}
+
+	m = rcu_dereference(priv->match);
+
+	/* This also protects access to all data related to scratch maps */
+	kernel_fpu_begin();
+
+	if (unlikely(!m || !*raw_cpu_ptr(m->scratch)))
+		goto out;
+
+	scratch = *raw_cpu_ptr(m->scratch);
+
+	map_index = scratch->map_index;
+
+	res_map  = scratch->map + (map_index ? m->bsize_max : 0);
+	fill_map = scratch->map + (map_index ? 0 : m->bsize_max);
+
+	memset(res_map, 0xff, m->bsize_max * sizeof(*res_map));
+
+	nft_pipapo_for_each_field(f, i, m) {
+		bool last = i == m->field_count - 1;
+		int b;
+
+		if (likely(f->bb == 8))
+			nft_pipapo_sse2_and_8b(f, res_map, rp);
+		else
+			nft_pipapo_sse2_and_4b(f, res_map, rp);
+		NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+		rp += f->groups / NFT_PIPAPO_GROUPS_PER_BYTE(f);
+
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0) {
+			scratch->map_index = map_index;
+			kernel_fpu_end();
+			local_bh_enable();
+
+			return false;
+		}
+
+		if (last) {
+			*ext = &f->mt[b].e->ext;
+			if (unlikely(nft_set_elem_expired(*ext) ||
+				     !nft_set_elem_active(*ext, genmask)))
+				goto next_match;
+
+			scratch->map_index = map_index;
+			kernel_fpu_end();
+			local_bh_enable();
+
+			return true;
+		}
+
+		map_index = !map_index;
+		swap(res_map, fill_map);
+
+		rp += NFT_PIPAPO_GROUPS_PADDING(f);
+	}
+
+out:
+	kernel_fpu_end();
+	local_bh_enable();
+	return false;
+}
@@ -488,6 +488,8 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	/* unread MSG_ZEROCOPY completions */
+	skb_queue_purge(&sk->sk_error_queue);
 
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
@@ -1874,6 +1876,32 @@ out:
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/*
+ * MSG_ZEROCOPY: pin up to @size bytes of the sender's pages into the frags
+ * of @skb, so the receiver copies the data straight out of them.  @size is
+ * trimmed to what fit.  The completion is queued on the sender's error
+ * queue once the last skb referencing @uarg has been consumed.
+ */
+static int unix_zerocopy_from_iter(struct sk_buff *skb, struct msghdr *msg,
+				   int *size, struct ubuf_info *uarg)
+{
+	int err;
+
+	/*
+	 * No socket here: unix_stream sockets account their skbs in
+	 * sk_wmem_alloc like datagrams, not in sk_wmem_queued like TCP.
+	 */
+	err = __zerocopy_sg_from_iter(NULL, skb, &msg->msg_iter, *size);
+	if (err == -EMSGSIZE && skb->len)
+		err = 0;	/* out of frags, the rest goes into the next skb */
+	if (err)
+		return err;
+
+	*size = skb->len;
+	skb_zcopy_set(skb, uarg, NULL);
+	return 0;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
@@ -1884,6 +1912,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	int sent = 0;
 	struct scm_cookie scm;
 	bool fds_sent = false;
+	struct ubuf_info *uarg = NULL;
 	int data_len;
 
 	wait_for_unix_gc();
@@ -1908,22 +1937,40 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (READ_ONCE(sk->sk_shutdown) & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		uarg = sock_zerocopy_alloc(sk, len);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		/* Keep two messages in the pipe so it schedules better */
 		size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
 
-		/* allow fallback to order-0 allocations */
-		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
+		if (uarg) {
+			/* user pages go into frags, no room needed */
+			skb = sock_alloc_send_pskb(sk, 0, 0,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err, 0);
+		} else {
+			/* allow fallback to order-0 allocations */
+			size = min_t(int, size,
+				     SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
-		data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
+			data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
 
-		data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
+			data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
 
-		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
-					   msg->msg_flags & MSG_DONTWAIT, &err,
-					   get_order(UNIX_SKB_FRAGS_SZ));
+			skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err,
+						   get_order(UNIX_SKB_FRAGS_SZ));
+		}
 		if (!skb)
 			goto out_err;
 
@@ -1935,10 +1982,15 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		}
 		fds_sent = true;
 
-		skb_put(skb, size - data_len);
-		skb->data_len = data_len;
-		skb->len = size;
-		err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, size);
+		if (uarg) {
+			err = unix_zerocopy_from_iter(skb, msg, &size, uarg);
+		} else {
+			skb_put(skb, size - data_len);
+			skb->data_len = data_len;
+			skb->len = size;
+			err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter,
+							  size);
+		}
 		if (err) {
 			kfree_skb(skb);
 			goto out_err;
@@ -1958,6 +2010,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		sent += size;
 	}
 
+	sock_zerocopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -1970,6 +2023,10 @@ pipe_err:
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		sock_zerocopy_put(uarg);
+	else
+		sock_zerocopy_put_abort(uarg, true);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -2037,7 +2094,7 @@ alloc_skb:
 	skb = skb_peek_tail(&other->sk_receive_queue);
 	if (tail && tail == skb) {
 		skb = newskb;
-	} else if (!skb || !unix_skb_scm_eq(skb, &scm)) {
+	} else if (!skb || !unix_skb_scm_eq(skb, &scm) || skb_zcopy(skb)) {
 		if (newskb) {
 			skb = newskb;
 		} else {
@@ -2417,6 +2474,18 @@ unlock:
 			sunaddr = NULL;
 		}
 
+		/*
+		 * Pages spliced into a pipe outlive the skb, and with it the
+		 * sender's completion notification, so don't hand out the
+		 * sender's pages.  This has to happen while the queue holds
+		 * the only reference, a shared skb can't have its frags copied.
+		 */
+		if (state->pipe) {
+			err = skb_orphan_frags_rx(skb, GFP_KERNEL);
+			if (err)
+				break;
+		}
+
 		chunk = min_t(unsigned int, unix_skb_len(skb) - skip, size);
 		skb_get(skb);
 		chunk = state->recv_actor(skb, skip, chunk, state);
@@ -2516,6 +2585,11 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.flags = flags
 	};
 
+	/* MSG_ZEROCOPY completions of our own sends */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sock->sk, msg, size, SOL_IP,
+					  IP_RECVERR);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -2710,7 +2784,7 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	state = READ_ONCE(sk->sk_state);
 
 	/* exceptional events? */
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
 		mask |= EPOLLERR;
 	if (shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;